@@ -9,6 +9,8 @@ find_package(LLVM 6.0 REQUIRED CONFIG)
 message(STATUS "LLVM: ${LLVM_DIR}")
 llvm_map_components_to_libnames(llvm_libs support core passes mcjit native DebugInfoDWARF)
 
+set(wavm_commit fa5434e03efbc2154ecf4aafede169da76a4da40)
+
 set(prefix ${CMAKE_BINARY_DIR}/deps)
 set(source_dir ${prefix}/src/wavm)
 set(binary_dir ${prefix}/src/wavm-build)
@@ -32,7 +34,7 @@ ExternalProject_Add(wavm
     DOWNLOAD_DIR ${prefix}/downloads
     SOURCE_DIR ${source_dir}
     BINARY_DIR ${binary_dir}
-    URL https://github.com/AndrewScheidecker/WAVM/archive/fa5434e03efbc2154ecf4aafede169da76a4da40.tar.gz
+    URL https://github.com/AndrewScheidecker/WAVM/archive/${wavm_commit}.tar.gz
     URL_HASH SHA256=1a380461ca6570b39d548dcedfacb3c105769d5d5957e85674253250f585c07d
     PATCH_COMMAND sh ${CMAKE_CURRENT_LIST_DIR}/patch_wavm.sh
     CMAKE_ARGS
@@ -57,7 +59,8 @@ set_target_properties(
     PROPERTIES
     IMPORTED_CONFIGURATIONS Release
     IMPORTED_LOCATION_RELEASE ${runtime_library}
-    INTERFACE_INCLUDE_DIRECTORIES ${include_dir}
+    INTERFACE_INCLUDE_DIRECTORIES "${include_dir};${LLVM_INCLUDE_DIRS}"
+    INTERFACE_COMPILE_DEFINITIONS "HERA_WAVM_COMMIT=\"${wavm_commit}\""
     INTERFACE_LINK_LIBRARIES "${other_libraries};${llvm_libs}"
 )
 
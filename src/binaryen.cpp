@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include <pass.h>
@@ -25,8 +28,9 @@
 #include <wasm-validator.h>
 
 #include "binaryen.h"
+#include "cache.h"
 #include "debugging.h"
-#include "eei.h"
+#include "eei-impl.h"
 #include "exceptions.h"
 
 #include "shell-interface.h"
@@ -35,20 +39,95 @@ using namespace std;
 
 namespace hera {
 
-class BinaryenEthereumInterface : public wasm::ShellExternalInterface, EthereumInterface {
+// The host functions of the EEI.
+enum class EEIFunction {
+  useGas,
+  getGasLeft,
+  getAddress,
+  getExternalBalance,
+  getBlockHash,
+  getCallDataSize,
+  callDataCopy,
+  getCaller,
+  getCallValue,
+  codeCopy,
+  getCodeSize,
+  externalCodeCopy,
+  getExternalCodeSize,
+  getBlockCoinbase,
+  getBlockDifficulty,
+  getBlockGasLimit,
+  getTxGasPrice,
+  log,
+  getBlockNumber,
+  getBlockTimestamp,
+  getTxOrigin,
+  storageStore,
+  storageLoad,
+  finish,
+  revert,
+  getReturnDataSize,
+  returnDataCopy,
+  call,
+  callCode,
+  callDelegate,
+  callStatic,
+  create,
+  selfDestruct,
+};
+
+// The memory and table of an instance right after instantiation.
+struct BinaryenInitialState {
+  struct MemorySegment {
+    size_t offset;
+    vector<char> const* data;
+  };
+
+  size_t memorySize = 0;
+  // The data segments with their offsets evaluated, in order of application.
+  vector<MemorySegment> memorySegments;
+  vector<wasm::Name> table;
+};
+
+// A parsed and validated module with its imports resolved to EEI functions,
+// so that host calls do not have to look up the functions by name.
+struct BinaryenModule {
+  wasm::Module module;
+  unordered_map<wasm::Import const*, EEIFunction> imports;
+
+  // Evaluated by the first instantiation, as the segment offsets may depend on globals.
+  once_flag initialStateEvaluated;
+  BinaryenInitialState initialState;
+};
+
+namespace {
+// Parsed and validated modules shared by every engine instance.
+// The limit on bytes is accounted in terms of the binary code size.
+CodeCache<BinaryenModule> moduleCache{1024, 64 * 1024 * 1024};
+}
+
+class BinaryenEthereumInterface : public wasm::ShellExternalInterface, EthereumInterface<BinaryenEthereumInterface> {
 public:
   explicit BinaryenEthereumInterface(
     evmc::HostContext& _context,
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _writeBack,
+    bool _bufferLogs,
+    BinaryenModule& _module
   ):
     ShellExternalInterface(),
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _writeBack, _bufferLogs),
+    m_module(_module)
   { }
 
+  using EthereumInterface::executionCompleted;
+
 protected:
+  void init(wasm::Module& wasm, wasm::ModuleInstance& instance) override;
+
   wasm::Literal callImport(wasm::Import *import, wasm::LiteralList& arguments) override;
 #if HERA_DEBUGGING
   wasm::Literal callDebugImport(wasm::Import *import, wasm::LiteralList& arguments);
@@ -61,15 +140,55 @@ protected:
   }
 
 private:
-  size_t memorySize() const override { return memory.size(); }
-  void memorySet(size_t offset, uint8_t value) override { memory.set<uint8_t>(offset, value); }
-  uint8_t memoryGet(size_t offset) override { return memory.get<uint8_t>(offset); }
-  uint8_t* memoryPointer(size_t offset, size_t length) override {
+  friend class EthereumInterface<BinaryenEthereumInterface>;
+
+  size_t memorySize() const { return memory.size(); }
+  uint8_t* memoryPointer(size_t offset, size_t length) {
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
     return reinterpret_cast<uint8_t*>(memory.rawpointer(offset));
   }
+
+  static BinaryenInitialState evaluateInitialState(wasm::Module& wasm, wasm::ModuleInstance& instance);
+
+  BinaryenModule& m_module;
 };
 
+  // Instead of evaluating and applying the segments one byte at a time, as the
+  // shell interface does, the memory is set up from the recorded initial state.
+  // Memory drawn from the pool is zeroed, hence only the segments are copied.
+  void BinaryenEthereumInterface::init(wasm::Module& wasm, wasm::ModuleInstance& instance) {
+    call_once(m_module.initialStateEvaluated, [&] {
+      m_module.initialState = evaluateInitialState(wasm, instance);
+    });
+
+    BinaryenInitialState const& state = m_module.initialState;
+    memory.resize(state.memorySize);
+    for (auto const& segment: state.memorySegments)
+      if (!segment.data->empty())
+        memcpy(memory.rawpointer(segment.offset), segment.data->data(), segment.data->size());
+    table = state.table;
+  }
+
+  BinaryenInitialState BinaryenEthereumInterface::evaluateInitialState(wasm::Module& wasm, wasm::ModuleInstance& instance) {
+    BinaryenInitialState state;
+
+    state.memorySize = wasm.memory.initial * wasm::Memory::kPageSize;
+    for (auto const& segment: wasm.memory.segments) {
+      size_t offset = static_cast<uint32_t>(wasm::ConstantExpressionRunner<wasm::TrivialGlobalManager>(instance.globals).visit(segment.offset).value.geti32());
+      ensureCondition(offset + segment.data.size() <= state.memorySize, InvalidMemoryAccess, "Data segment does not fit into memory.");
+      state.memorySegments.push_back({offset, &segment.data});
+    }
+
+    state.table.resize(wasm.table.initial);
+    for (auto const& segment: wasm.table.segments) {
+      size_t offset = static_cast<uint32_t>(wasm::ConstantExpressionRunner<wasm::TrivialGlobalManager>(instance.globals).visit(segment.offset).value.geti32());
+      ensureCondition(offset + segment.data.size() <= state.table.size(), InvalidMemoryAccess, "Table segment does not fit into table.");
+      copy(segment.data.begin(), segment.data.end(), state.table.begin() + static_cast<ptrdiff_t>(offset));
+    }
+
+    return state;
+  }
+
   void BinaryenEthereumInterface::importGlobals(map<wasm::Name, wasm::Literal>& globals, wasm::Module& wasm) {
     (void)globals;
     (void)wasm;
@@ -139,17 +258,19 @@ private:
 #endif
 
   wasm::Literal BinaryenEthereumInterface::callImport(wasm::Import *import, wasm::LiteralList& arguments) {
+    // The signatures have been checked when resolving the imports.
+    auto const it = m_module.imports.find(import);
 #if HERA_DEBUGGING
-    if (import->module == wasm::Name("debug"))
+    if (it == m_module.imports.end() && import->module == wasm::Name("debug"))
       // Reroute to debug namespace
       return callDebugImport(import, arguments);
 #endif
 
-    heraAssert(import->module == wasm::Name("ethereum"), "Only imports from the 'ethereum' namespace are allowed.");
-
-    if (import->base == wasm::Name("useGas")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
+    heraAssert(it != m_module.imports.end(), string("Unsupported import called: ") + import->module.str + "::" + import->base.str);
 
+    EEIFunction const function = it->second;
+    switch (function) {
+    case EEIFunction::useGas: {
       int64_t gas = arguments[0].geti64();
 
       eeiUseGas(gas);
@@ -157,15 +278,11 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getGasLeft")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getGasLeft: {
       return wasm::Literal(eeiGetGasLeft());
     }
 
-    if (import->base == wasm::Name("getAddress")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getAddress: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetAddress(resultOffset);
@@ -173,9 +290,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getExternalBalance")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getExternalBalance: {
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
@@ -184,24 +299,18 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockHash")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockHash: {
       uint64_t number = static_cast<uint64_t>(arguments[0].geti64());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
       return wasm::Literal(eeiGetBlockHash(number, resultOffset));
     }
 
-    if (import->base == wasm::Name("getCallDataSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getCallDataSize: {
       return wasm::Literal(eeiGetCallDataSize());
     }
 
-    if (import->base == wasm::Name("callDataCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::callDataCopy: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t dataOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
@@ -211,9 +320,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCaller")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getCaller: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetCaller(resultOffset);
@@ -221,9 +328,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCallValue")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getCallValue: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetCallValue(resultOffset);
@@ -231,9 +336,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("codeCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::codeCopy: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t codeOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
@@ -243,15 +346,11 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCodeSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getCodeSize: {
       return wasm::Literal(eeiGetCodeSize());
     }
 
-    if (import->base == wasm::Name("externalCodeCopy")) {
-      heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::externalCodeCopy: {
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t codeOffset = static_cast<uint32_t>(arguments[2].geti32());
@@ -262,17 +361,13 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getExternalCodeSize")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getExternalCodeSize: {
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       return wasm::Literal(eeiGetExternalCodeSize(addressOffset));
     }
 
-    if (import->base == wasm::Name("getBlockCoinbase")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockCoinbase: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetBlockCoinbase(resultOffset);
@@ -280,9 +375,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockDifficulty")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockDifficulty: {
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetBlockDifficulty(offset);
@@ -290,15 +383,11 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockGasLimit")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockGasLimit: {
       return wasm::Literal(eeiGetBlockGasLimit());
     }
 
-    if (import->base == wasm::Name("getTxGasPrice")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getTxGasPrice: {
       uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetTxGasPrice(valueOffset);
@@ -306,9 +395,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("log")) {
-      heraAssert(arguments.size() == 7, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::log: {
       uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t numberOfTopics = static_cast<uint32_t>(arguments[2].geti32());
@@ -322,21 +409,15 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockNumber")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockNumber: {
       return wasm::Literal(eeiGetBlockNumber());
     }
 
-    if (import->base == wasm::Name("getBlockTimestamp")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getBlockTimestamp: {
       return wasm::Literal(eeiGetBlockTimestamp());
     }
 
-    if (import->base == wasm::Name("getTxOrigin")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getTxOrigin: {
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       eeiGetTxOrigin(resultOffset);
@@ -344,9 +425,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("storageStore")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::storageStore: {
       uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t valueOffset = static_cast<uint32_t>(arguments[1].geti32());
 
@@ -355,9 +434,7 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("storageLoad")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::storageLoad: {
       uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
@@ -366,35 +443,29 @@ private:
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("finish")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::finish: {
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
 
       // This traps.
       eeiFinish(offset, size);
+      return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("revert")) {
-      heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::revert: {
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
 
       // This traps.
       eeiRevert(offset, size);
+      return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getReturnDataSize")) {
-      heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::getReturnDataSize: {
       return wasm::Literal(eeiGetReturnDataSize());
     }
 
-    if (import->base == wasm::Name("returnDataCopy")) {
-      heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::returnDataCopy: {
       uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t offset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[2].geti32());
@@ -404,29 +475,19 @@ private:
       return wasm::Literal();
     }
 
-    if (
-      import->base == wasm::Name("call") ||
-      import->base == wasm::Name("callCode") ||
-      import->base == wasm::Name("callDelegate") ||
-      import->base == wasm::Name("callStatic")
-    ) {
+    case EEIFunction::call:
+    case EEIFunction::callCode:
+    case EEIFunction::callDelegate:
+    case EEIFunction::callStatic: {
       EEICallKind kind;
-      if (import->base == wasm::Name("call"))
+      if (function == EEIFunction::call)
         kind = EEICallKind::Call;
-      else if (import->base == wasm::Name("callCode"))
+      else if (function == EEIFunction::callCode)
         kind = EEICallKind::CallCode;
-      else if (import->base == wasm::Name("callDelegate"))
+      else if (function == EEIFunction::callDelegate)
         kind = EEICallKind::CallDelegate;
-      else if (import->base == wasm::Name("callStatic"))
-        kind = EEICallKind::CallStatic;
       else
-        heraAssert(false, "");
-
-      if ((kind == EEICallKind::Call) || (kind == EEICallKind::CallCode)) {
-        heraAssert(arguments.size() == 5, string("Argument count mismatch in: ") + import->base.str);
-      } else {
-        heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-      }
+        kind = EEICallKind::CallStatic;
 
       int64_t gas = arguments[0].geti64();
       uint32_t addressOffset = static_cast<uint32_t>(arguments[1].geti32());
@@ -447,9 +508,7 @@ private:
       return wasm::Literal(eeiCall(kind, gas, addressOffset, valueOffset, dataOffset, dataLength));
     }
 
-    if (import->base == wasm::Name("create")) {
-      heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::create: {
       uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t dataOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
@@ -458,13 +517,14 @@ private:
       return wasm::Literal(eeiCreate(valueOffset, dataOffset, length, resultOffset));
     }
 
-    if (import->base == wasm::Name("selfDestruct")) {
-      heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
-
+    case EEIFunction::selfDestruct: {
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
 
       // This traps.
       eeiSelfDestruct(addressOffset);
+      return wasm::Literal();
+    }
+
     }
 
     heraAssert(false, string("Unsupported import called: ") + import->module.str + "::" + import->base.str + " (" + to_string(arguments.size()) + "arguments)");
@@ -481,26 +541,21 @@ ExecutionResult BinaryenEngine::execute(
   bytes_view code,
   bytes_view state_code,
   evmc_message const& msg,
-  bool meterInterfaceGas
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
 ) {
   instantiationStarted();
-  wasm::Module module;
-
-  // Load module
-  loadModule(code, module);
 
-  // Print
-  // WasmPrinter::printModule(module);
-
-  // Validate
-  verifyContract(module);
+  // Load and validate module (or fetch it from the cache)
+  shared_ptr<BinaryenModule> module = loadVerifiedModule(code);
 
   // NOTE: DO NOT use the optimiser here, it will conflict with metering
 
   // Interpret
   ExecutionResult result;
-  BinaryenEthereumInterface interface(context, state_code, msg, result, meterInterfaceGas);
-  wasm::ModuleInstance instance(module, &interface);
+  BinaryenEthereumInterface interface(context, state_code, msg, result, meterInterfaceGas, storageWriteBack, logBuffering, *module);
+  wasm::ModuleInstance instance(module->module, &interface);
 
   executionStarted();
 
@@ -512,6 +567,7 @@ ExecutionResult BinaryenEngine::execute(
     // This exception is ignored here because we consider it to be a success.
     // It is only a clutch for POSIX style exit()
   }
+  interface.executionCompleted();
 
   executionFinished();
   return result;
@@ -522,6 +578,7 @@ void BinaryenEngine::loadModule(bytes_view code, wasm::Module& module)
   try {
     auto const b = reinterpret_cast<char const*>(code.begin());
     auto const e = reinterpret_cast<char const*>(code.end());
+    // The parser only accepts a vector, but this only happens once per cached module.
     std::vector<char> codeCopy{b, e};
     wasm::WasmBinaryBuilder parser(module, codeCopy, false);
     parser.read();
@@ -533,11 +590,27 @@ void BinaryenEngine::loadModule(bytes_view code, wasm::Module& module)
   }
 }
 
+shared_ptr<BinaryenModule> BinaryenEngine::loadVerifiedModule(bytes_view code)
+{
+  if (auto cached = moduleCache.find(code))
+    return cached;
+
+  auto module = make_shared<BinaryenModule>();
+  loadModule(code, module->module);
+
+  // Print
+  // WasmPrinter::printModule(*module);
+
+  // Only valid modules are cached.
+  verifyContract(*module);
+
+  return moduleCache.insert(code, move(module), code.size());
+}
+
 void BinaryenEngine::verifyContract(bytes_view code)
 {
-  wasm::Module module;
-  loadModule(code, module);
-  verifyContract(module);
+  // This also warms the cache for the deployed code.
+  loadVerifiedModule(code);
 }
 
 namespace {
@@ -549,8 +622,10 @@ wasm::FunctionType createFunctionType(vector<wasm::Type> params, wasm::Type resu
 }
 }
 
-void BinaryenEngine::verifyContract(wasm::Module & module)
+void BinaryenEngine::verifyContract(BinaryenModule& compiled)
 {
+  wasm::Module& module = compiled.module;
+
   ensureCondition(
     wasm::WasmValidator().validate(module),
     ContractValidationFailure,
@@ -599,40 +674,45 @@ void BinaryenEngine::verifyContract(wasm::Module & module)
     "Contract is invalid. \"main\" has an invalid signature."
   );
 
-  static const map<wasm::Name const, wasm::FunctionType const> eei_signatures{
-    { wasm::Name("useGas"), createFunctionType({ wasm::Type::i64 }, wasm::Type::none) },
-    { wasm::Name("getGasLeft"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getAddress"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getExternalBalance"), createFunctionType({ wasm::Type::i32,wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockHash"), createFunctionType({ wasm::Type::i64, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("getCallDataSize"), createFunctionType({}, wasm::Type::i32) },
-    { wasm::Name("callDataCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getCaller"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getCallValue"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("codeCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("getCodeSize"), createFunctionType({}, wasm::Type::i32) },
-    { wasm::Name("externalCodeCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getExternalCodeSize"), createFunctionType({ wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("getBlockCoinbase"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockDifficulty"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockGasLimit"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getTxGasPrice"), createFunctionType({ wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("log"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getBlockNumber"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getBlockTimestamp"), createFunctionType({}, wasm::Type::i64) },
-    { wasm::Name("getTxOrigin"), createFunctionType({ wasm::Type::i32}, wasm::Type::none) },
-    { wasm::Name("storageStore"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("storageLoad"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("finish"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("revert"), createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("getReturnDataSize"), createFunctionType({ }, wasm::Type::i32) },
-    { wasm::Name("returnDataCopy"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) },
-    { wasm::Name("call"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callCode"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callDelegate"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("callStatic"), createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("create"), createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) },
-    { wasm::Name("selfDestruct"), createFunctionType({ wasm::Type::i32 }, wasm::Type::none) }
+  struct EEIImport {
+    EEIFunction function;
+    wasm::FunctionType type;
+  };
+
+  static const map<wasm::Name const, EEIImport const> eei_signatures{
+    { wasm::Name("useGas"), { EEIFunction::useGas, createFunctionType({ wasm::Type::i64 }, wasm::Type::none) } },
+    { wasm::Name("getGasLeft"), { EEIFunction::getGasLeft, createFunctionType({}, wasm::Type::i64) } },
+    { wasm::Name("getAddress"), { EEIFunction::getAddress, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getExternalBalance"), { EEIFunction::getExternalBalance, createFunctionType({ wasm::Type::i32,wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getBlockHash"), { EEIFunction::getBlockHash, createFunctionType({ wasm::Type::i64, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("getCallDataSize"), { EEIFunction::getCallDataSize, createFunctionType({}, wasm::Type::i32) } },
+    { wasm::Name("callDataCopy"), { EEIFunction::callDataCopy, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getCaller"), { EEIFunction::getCaller, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getCallValue"), { EEIFunction::getCallValue, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("codeCopy"), { EEIFunction::codeCopy, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32}, wasm::Type::none) } },
+    { wasm::Name("getCodeSize"), { EEIFunction::getCodeSize, createFunctionType({}, wasm::Type::i32) } },
+    { wasm::Name("externalCodeCopy"), { EEIFunction::externalCodeCopy, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getExternalCodeSize"), { EEIFunction::getExternalCodeSize, createFunctionType({ wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("getBlockCoinbase"), { EEIFunction::getBlockCoinbase, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getBlockDifficulty"), { EEIFunction::getBlockDifficulty, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getBlockGasLimit"), { EEIFunction::getBlockGasLimit, createFunctionType({}, wasm::Type::i64) } },
+    { wasm::Name("getTxGasPrice"), { EEIFunction::getTxGasPrice, createFunctionType({ wasm::Type::i32}, wasm::Type::none) } },
+    { wasm::Name("log"), { EEIFunction::log, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getBlockNumber"), { EEIFunction::getBlockNumber, createFunctionType({}, wasm::Type::i64) } },
+    { wasm::Name("getBlockTimestamp"), { EEIFunction::getBlockTimestamp, createFunctionType({}, wasm::Type::i64) } },
+    { wasm::Name("getTxOrigin"), { EEIFunction::getTxOrigin, createFunctionType({ wasm::Type::i32}, wasm::Type::none) } },
+    { wasm::Name("storageStore"), { EEIFunction::storageStore, createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("storageLoad"), { EEIFunction::storageLoad, createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("finish"), { EEIFunction::finish, createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("revert"), { EEIFunction::revert, createFunctionType({ wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("getReturnDataSize"), { EEIFunction::getReturnDataSize, createFunctionType({ }, wasm::Type::i32) } },
+    { wasm::Name("returnDataCopy"), { EEIFunction::returnDataCopy, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::none) } },
+    { wasm::Name("call"), { EEIFunction::call, createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("callCode"), { EEIFunction::callCode, createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("callDelegate"), { EEIFunction::callDelegate, createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("callStatic"), { EEIFunction::callStatic, createFunctionType({ wasm::Type::i64, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("create"), { EEIFunction::create, createFunctionType({ wasm::Type::i32, wasm::Type::i32, wasm::Type::i32, wasm::Type::i32 }, wasm::Type::i32) } },
+    { wasm::Name("selfDestruct"), { EEIFunction::selfDestruct, createFunctionType({ wasm::Type::i32 }, wasm::Type::none) } }
   };
 
   for (auto const& import: module.imports) {
@@ -652,8 +732,9 @@ void BinaryenEngine::verifyContract(wasm::Module & module)
       ContractValidationFailure,
       "Importing invalid EEI method."
     );
+    EEIImport const& eei_import = eei_signatures.at(import->base);
     // NOTE: needs to be a copy by value due to `structuralComparison` requiring a non-const input
-    wasm::FunctionType eei_function_type = eei_signatures.at(import->base);
+    wasm::FunctionType eei_function_type = eei_import.type;
 
     wasm::FunctionType* function_type = module.getFunctionTypeOrNull(import->functionType);
     ensureCondition(
@@ -667,6 +748,8 @@ void BinaryenEngine::verifyContract(wasm::Module & module)
       ContractValidationFailure,
       "Imported function type mismatch."
     );
+
+    compiled.imports[import.get()] = eei_import.function;
   }
 }
 
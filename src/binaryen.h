@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include "eei.h"
 
 namespace wasm {
@@ -24,6 +26,8 @@ class Module;
 
 namespace hera {
 
+struct BinaryenModule;
+
 class BinaryenEngine : public WasmEngine {
 public:
   /// Factory method to create the Binaryen Wasm Engine.
@@ -34,13 +38,20 @@ public:
     bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
   ) override;
 
   void verifyContract(bytes_view code) override;
 
 private:
-  void verifyContract(wasm::Module& module);
+  /// Also resolves the imports of the module.
+  void verifyContract(BinaryenModule& module);
+
+  /// Returns the parsed and validated module for the code.
+  /// Modules are cached process-wide and must not be modified.
+  std::shared_ptr<BinaryenModule> loadVerifiedModule(bytes_view code);
 
   /// Parses and loads a Wasm module.
   /// Don't ask, Module has no copy constructor, hence the reference.
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "debugging.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+constexpr char cacheFileMagic[8] = {'h', 'e', 'r', 'a', 'c', 'a', 'c', 'h'};
+constexpr uint32_t cacheFileFormat = 1;
+
+// The file layout is the header, followed by the tag, the key and the value.
+struct CacheFileHeader {
+  char magic[8];
+  uint32_t format;
+  uint32_t tagSize;
+  uint64_t keySize;
+  uint64_t valueSize;
+  uint64_t valueChecksum;
+};
+
+// Whether only the current user can have modified the file.
+bool isTrusted(struct stat const& st)
+{
+  return st.st_uid == ::geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool writeAll(int fd, void const* data, size_t size)
+{
+  auto ptr = static_cast<uint8_t const*>(data);
+  while (size > 0) {
+    ssize_t written = ::write(fd, ptr, size);
+    if (written < 0)
+      return false;
+    ptr += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+}
+
+DiskCacheEntry::DiskCacheEntry(DiskCacheEntry&& other) noexcept:
+  m_mapping(exchange(other.m_mapping, nullptr)),
+  m_mappingSize(exchange(other.m_mappingSize, 0)),
+  m_value(exchange(other.m_value, {}))
+{}
+
+DiskCacheEntry& DiskCacheEntry::operator=(DiskCacheEntry&& other) noexcept
+{
+  if (this != &other) {
+    if (m_mapping)
+      ::munmap(m_mapping, m_mappingSize);
+    m_mapping = exchange(other.m_mapping, nullptr);
+    m_mappingSize = exchange(other.m_mappingSize, 0);
+    m_value = exchange(other.m_value, {});
+  }
+  return *this;
+}
+
+DiskCacheEntry::~DiskCacheEntry() noexcept
+{
+  if (m_mapping)
+    ::munmap(m_mapping, m_mappingSize);
+}
+
+DiskCache::DiskCache(string directory, string name, string tag):
+  m_directory(move(directory)),
+  m_name(move(name)),
+  m_tag(move(tag))
+{}
+
+bool DiskCache::isValidDirectory(string const& directory)
+{
+  struct stat st;
+  return ::stat(directory.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && isTrusted(st);
+}
+
+string DiskCache::path(bytes_view key) const
+{
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(codeHash(key)));
+  return m_directory + "/" + m_name + "-" + hash + ".bin";
+}
+
+DiskCacheEntry DiskCache::load(bytes_view key) const
+{
+  DiskCacheEntry entry;
+
+  // The permissions of the directory may have changed since it was set.
+  if (!isValidDirectory(m_directory)) {
+    HERA_DEBUG << "Ignoring cache directory " << m_directory << " writable by other users\n";
+    return entry;
+  }
+
+  int fd = ::open(path(key).c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0)
+    return entry;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !isTrusted(st) || st.st_size < static_cast<off_t>(sizeof(CacheFileHeader))) {
+    ::close(fd);
+    return entry;
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    return entry;
+
+  entry.m_mapping = mapping;
+  entry.m_mappingSize = size;
+
+  auto const data = static_cast<uint8_t const*>(mapping);
+  CacheFileHeader header;
+  memcpy(&header, data, sizeof(header));
+
+  // Check each part fits into the file before looking at it.
+  size_t remaining = size - sizeof(header);
+  bool valid =
+    memcmp(header.magic, cacheFileMagic, sizeof(cacheFileMagic)) == 0 &&
+    header.format == cacheFileFormat &&
+    header.tagSize <= remaining &&
+    header.keySize <= remaining - header.tagSize &&
+    header.valueSize == remaining - header.tagSize - header.keySize;
+
+  if (valid) {
+    auto const tag = data + sizeof(header);
+    auto const storedKey = tag + header.tagSize;
+    bytes_view value{storedKey + header.keySize, header.valueSize};
+    valid =
+      m_tag.compare(0, string::npos, reinterpret_cast<char const*>(tag), header.tagSize) == 0 &&
+      key == bytes_view(storedKey, header.keySize) &&
+      header.valueChecksum == codeHash(value);
+    entry.m_value = value;
+  }
+
+  if (!valid) {
+    HERA_DEBUG << "Ignoring invalid or stale cache file " << path(key) << "\n";
+    return DiskCacheEntry{};
+  }
+
+  return entry;
+}
+
+void DiskCache::store(bytes_view key, bytes_view value) const
+{
+  string const target = path(key);
+  string temporary = target + ".XXXXXX";
+
+  int fd = ::mkstemp(&temporary[0]);
+  if (fd < 0) {
+    HERA_DEBUG << "Failed to create cache file " << temporary << "\n";
+    return;
+  }
+
+  CacheFileHeader header;
+  memcpy(header.magic, cacheFileMagic, sizeof(cacheFileMagic));
+  header.format = cacheFileFormat;
+  header.tagSize = static_cast<uint32_t>(m_tag.size());
+  header.keySize = key.size();
+  header.valueSize = value.size();
+  header.valueChecksum = codeHash(value);
+
+  bool written =
+    writeAll(fd, &header, sizeof(header)) &&
+    writeAll(fd, m_tag.data(), m_tag.size()) &&
+    writeAll(fd, key.data(), key.size()) &&
+    writeAll(fd, value.data(), value.size());
+  ::fchmod(fd, 0644);
+  ::close(fd);
+
+  // Readers only ever see complete files.
+  if (!written || ::rename(temporary.c_str(), target.c_str()) != 0) {
+    HERA_DEBUG << "Failed to write cache file " << target << "\n";
+    ::unlink(temporary.c_str());
+  }
+}
+
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "helpers.h"
+
+namespace hera {
+
+struct CodeHasher {
+  size_t operator()(bytes_view code) const noexcept { return codeHash(code); }
+};
+
+/// A size-bounded least-recently-used cache keyed by contract code.
+///
+/// Lookups go through the code hash, but the full code is kept and compared,
+/// hence a hash collision never returns the entry of another contract.
+/// Values are shared: an entry evicted while in use stays alive until its last
+/// user releases it.
+///
+/// All methods are thread-safe, but access to the values is not synchronised.
+template <typename Value>
+class CodeCache {
+public:
+  using ValuePtr = std::shared_ptr<Value>;
+
+  CodeCache(size_t maxEntries, size_t maxBytes) noexcept:
+    m_maxEntries(maxEntries),
+    m_maxBytes(maxBytes)
+  {}
+
+  CodeCache(CodeCache const&) = delete;
+  CodeCache& operator=(CodeCache const&) = delete;
+
+  /// Returns the value cached for @code or nullptr.
+  ValuePtr find(bytes_view code)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_index.find(code);
+    if (it == m_index.end())
+      return nullptr;
+    // Mark as most recently used.
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->value;
+  }
+
+  /// Inserts @value for @code, where @cost is the number of bytes accounted
+  /// against the size limit. If @code has been inserted in the meantime
+  /// the existing value is kept.
+  /// @returns the value cached for @code.
+  ValuePtr insert(bytes_view code, ValuePtr value, size_t cost)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_index.find(code);
+    if (it != m_index.end())
+      return it->second->value;
+
+    if (m_maxEntries == 0 || cost > m_maxBytes)
+      return value;
+
+    m_entries.push_front(Entry{bytes{code}, value, cost});
+    // The key refers to the copy owned by the entry, list nodes are never relocated.
+    m_index.emplace(m_entries.front().code, m_entries.begin());
+    m_bytes += cost;
+    evict();
+    return value;
+  }
+
+  void setMaxEntries(size_t maxEntries)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_maxEntries = maxEntries;
+    evict();
+  }
+
+  void setMaxBytes(size_t maxBytes)
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_maxBytes = maxBytes;
+    evict();
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = 0;
+  }
+
+private:
+  struct Entry {
+    bytes code;
+    ValuePtr value;
+    size_t cost;
+  };
+
+  // Drops the least recently used entries until within limits. Expects the lock to be held.
+  void evict()
+  {
+    while (!m_entries.empty() && (m_entries.size() > m_maxEntries || m_bytes > m_maxBytes)) {
+      Entry const& last = m_entries.back();
+      m_bytes -= last.cost;
+      m_index.erase(last.code);
+      m_entries.pop_back();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::list<Entry> m_entries;
+  std::unordered_map<bytes_view, typename std::list<Entry>::iterator, CodeHasher> m_index;
+  size_t m_maxEntries;
+  size_t m_maxBytes;
+  size_t m_bytes = 0;
+};
+
+/// A value loaded from a DiskCache. The file stays mapped into memory for the
+/// lifetime of this object, so that the value is read without a buffer of its own.
+class DiskCacheEntry {
+public:
+  DiskCacheEntry() noexcept = default;
+  DiskCacheEntry(DiskCacheEntry&& other) noexcept;
+  DiskCacheEntry& operator=(DiskCacheEntry&& other) noexcept;
+  ~DiskCacheEntry() noexcept;
+
+  explicit operator bool() const noexcept { return m_mapping != nullptr; }
+
+  bytes_view value() const noexcept { return m_value; }
+
+private:
+  friend class DiskCache;
+
+  void* m_mapping = nullptr;
+  size_t m_mappingSize = 0;
+  bytes_view m_value;
+};
+
+/// A directory of files each holding a value computed from a key (i.e. contract code).
+///
+/// Files are named after the hash of the key, and they store the key itself, a tag and
+/// a checksum of the value. The tag must identify everything else the value depends on,
+/// such as the Hera version and the relevant options. Files with a different key or tag
+/// and corrupt files are ignored.
+///
+/// Files are replaced atomically, hence a directory can be shared by several processes.
+/// As the values may be executable code, the directory and the files must be owned by
+/// the current user and writable by no one else, otherwise they are ignored.
+class DiskCache {
+public:
+  /// @name is used as the prefix of the file names.
+  DiskCache(std::string directory, std::string name, std::string tag);
+
+  /// @returns whether @directory is a directory owned by the current user and
+  /// writable by no one else.
+  static bool isValidDirectory(std::string const& directory);
+
+  /// @returns the value stored for @key or an empty entry.
+  DiskCacheEntry load(bytes_view key) const;
+
+  /// Stores @value for @key. Failures are ignored.
+  void store(bytes_view key, bytes_view value) const;
+
+private:
+  std::string path(bytes_view key) const;
+
+  std::string m_directory;
+  std::string m_name;
+  std::string m_tag;
+};
+
+}
@@ -0,0 +1,955 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "debugging.h"
+#include "eei.h"
+#include "exceptions.h"
+#include "helpers.h"
+
+#include <evmc/instructions.h>
+
+// The definitions of EthereumInterface, to be included by the engines only.
+// They are compiled for each engine, with its memory accessors inlined.
+
+namespace hera {
+
+/* Checks if host supplied 256 bit value exceeds UINT128_MAX */
+inline bool exceedsUint128(evmc::uint256be const& value) noexcept
+{
+    for (unsigned i = 0; i < 16; i++)
+    {
+        if (value.bytes[i])
+            return true;
+    }
+    return false;
+}
+
+#if HERA_DEBUGGING
+  template <typename Derived>
+  void EthereumInterface<Derived>::debugPrint32(uint32_t value)
+  {
+      std::cerr << depthToString() << " DEBUG print32: " << value << " " << std::hex << "0x" << value << std::dec << std::endl;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::debugPrint64(uint64_t value)
+  {
+      std::cerr << depthToString() << " DEBUG print64: " << value << " " << std::hex << "0x" << value << std::dec << std::endl;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::debugPrintMem(bool useHex, uint32_t offset, uint32_t length)
+  {
+      heraAssert((offset + length) > offset, "Overflow.");
+      heraAssert(derived().memorySize() >= (offset + length), "Out of memory bounds.");
+
+      std::cerr << depthToString() << " DEBUG printMem" << (useHex ? "Hex(" : "(") << std::hex << "0x" << offset << ":0x" << length << "): " << std::dec;
+      uint8_t const* memory = derived().memoryPointer(offset, length);
+      if (useHex)
+      {
+        std::cerr << std::hex;
+        for (uint32_t i = 0; i < length; i++) {
+          std::cerr << static_cast<int>(memory[i]) << " ";
+        }
+        std::cerr << std::dec;
+      }
+      else
+      {
+        for (uint32_t i = 0; i < length; i++) {
+          std::cerr << memory[i] << " ";
+        }
+      }
+      std::cerr << std::endl;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::debugPrintStorage(bool useHex, uint32_t pathOffset)
+  {
+      evmc::uint256be path = loadBytes32(pathOffset);
+
+      HERA_DEBUG << depthToString() << " DEBUG printStorage" << (useHex ? "Hex" : "") << "(0x" << std::hex;
+
+      // Print out the path
+      for (uint8_t b: path.bytes)
+        std::cerr << static_cast<int>(b);
+
+      HERA_DEBUG << "): " << std::dec;
+
+      // Read through the storage cache, which holds any value not yet written back.
+      evmc::bytes32 result = storageSlot(path).current;
+
+      if (useHex)
+      {
+        std::cerr << std::hex;
+        for (uint8_t b: result.bytes)
+          std::cerr << static_cast<int>(b) << " ";
+        std::cerr << std::dec;
+      }
+      else
+      {
+        for (uint8_t b: result.bytes)
+          std::cerr << b << " ";
+      }
+      std::cerr << std::endl;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::debugEvmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp)
+  {
+      HERA_DEBUG << depthToString() << " evmTrace\n";
+
+      static constexpr int stackItemSize = sizeof(evmc::uint256be);
+      heraAssert(sp <= (1024 * stackItemSize), "EVM stack pointer out of bounds.");
+      heraAssert(opcode >= 0x00 && opcode <= 0xff, "Invalid EVM instruction.");
+
+      const char* const* const opNamesTable = evmc_get_instruction_names_table(EVMC_BYZANTIUM);
+      const char* opName = opNamesTable[static_cast<uint8_t>(opcode)];
+      if (opName == nullptr)
+        opName = "UNDEFINED";
+
+      std::cout << "{\"depth\":" << std::dec << m_msg.depth
+        << ",\"gas\":" << m_result.gasLeft
+        << ",\"gasCost\":" << cost
+        << ",\"op\":" << opName
+        << ",\"pc\":" << pc
+        << ",\"stack\":[";
+
+      for (int32_t i = 0; i <= sp; i += stackItemSize) {
+        evmc::uint256be x = loadUint256(static_cast<uint32_t>(i));
+        std::cout << '"' << toHex(x) << '"';
+        if (i != sp)
+          std::cout << ',';
+      }
+      std::cout << "]}" << std::endl;
+  }
+#endif
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiUseGas(int64_t gas)
+  {
+      HERA_DEBUG << depthToString() << " useGas " << gas << "\n";
+
+      ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
+
+      takeGas(gas);
+  }
+
+  template <typename Derived>
+  int64_t EthereumInterface<Derived>::eeiGetGasLeft()
+  {
+      HERA_DEBUG << depthToString() << " getGasLeft\n";
+
+      static_assert(std::is_same<decltype(m_result.gasLeft), int64_t>::value, "int64_t type expected");
+
+      takeInterfaceGas(GasSchedule::base);
+
+      return m_result.gasLeft;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetAddress(uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getAddress " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeAddress(m_msg.recipient, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetExternalBalance(uint32_t addressOffset, uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getExternalBalance " << std::hex << addressOffset << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::balance);
+
+      evmc::address address = loadAddress(addressOffset);
+      evmc::uint256be balance = m_host.get_balance(address);
+      storeUint128(balance, resultOffset);
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiGetBlockHash(uint64_t number, uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getBlockHash " << std::hex << number << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::blockhash);
+
+      const auto blockhash = m_host.get_block_hash(static_cast<int64_t>(number));
+
+      if (is_zero(blockhash))
+        return 1;
+
+      storeBytes32(blockhash, resultOffset);
+
+      return 0;
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiGetCallDataSize()
+  {
+      HERA_DEBUG << depthToString() << " getCallDataSize\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      return static_cast<uint32_t>(m_msg.input_size);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiCallDataCopy(uint32_t resultOffset, uint32_t dataOffset, uint32_t length)
+  {
+      HERA_DEBUG << depthToString() << " callDataCopy " << std::hex << resultOffset << " " << dataOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule::verylow);
+
+      storeMemory({m_msg.input_data, m_msg.input_size}, dataOffset, resultOffset, length);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetCaller(uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getCaller " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeAddress(m_msg.sender, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetCallValue(uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getCallValue " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeUint128(m_msg.value, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiCodeCopy(uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
+  {
+      HERA_DEBUG << depthToString() << " codeCopy " << std::hex << resultOffset << " " << codeOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule::verylow);
+
+      storeMemory(m_code, codeOffset, resultOffset, length);
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiGetCodeSize()
+  {
+      HERA_DEBUG << depthToString() << " getCodeSize\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      return static_cast<uint32_t>(m_code.size());
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiExternalCodeCopy(uint32_t addressOffset, uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
+  {
+      HERA_DEBUG << depthToString() << " externalCodeCopy " << std::hex << addressOffset << " " << resultOffset << " " << codeOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule::extcode);
+
+      evmc::address address = loadAddress(addressOffset);
+
+      // The host copies straight into memory.
+      ensureCondition((resultOffset + length) >= resultOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+      ensureCondition(derived().memorySize() >= (resultOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+      if (!length)
+        return;
+
+      size_t numCopied = m_host.copy_code(address, codeOffset, derived().memoryPointer(resultOffset, length), length);
+      ensureCondition(numCopied == length, InvalidMemoryAccess, "Out of bounds (source) memory copy");
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiGetExternalCodeSize(uint32_t addressOffset)
+  {
+      HERA_DEBUG << depthToString() << " getExternalCodeSize " << std::hex << addressOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::extcode);
+
+      evmc::address address = loadAddress(addressOffset);
+      size_t code_size = m_host.get_code_size(address);
+
+      return static_cast<uint32_t>(code_size);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetBlockCoinbase(uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getBlockCoinbase " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeAddress(m_host.get_tx_context().block_coinbase, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetBlockDifficulty(uint32_t offset)
+  {
+      HERA_DEBUG << depthToString() << " getBlockDifficulty " << std::hex << offset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeUint256(m_host.get_tx_context().block_prev_randao, offset);
+  }
+
+  template <typename Derived>
+  int64_t EthereumInterface<Derived>::eeiGetBlockGasLimit()
+  {
+      HERA_DEBUG << depthToString() << " getBlockGasLimit\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      static_assert(std::is_same<decltype(m_host.get_tx_context().block_gas_limit), int64_t>::value, "int64_t type expected");
+
+      return m_host.get_tx_context().block_gas_limit;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetTxGasPrice(uint32_t valueOffset)
+  {
+      HERA_DEBUG << depthToString() << " getTxGasPrice " << std::hex << valueOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeUint128(m_host.get_tx_context().tx_gas_price, valueOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiLog(uint32_t dataOffset, uint32_t length, uint32_t numberOfTopics, uint32_t topic1, uint32_t topic2, uint32_t topic3, uint32_t topic4)
+  {
+      HERA_DEBUG << depthToString() << " log " << std::hex << dataOffset << " " << length << " " << numberOfTopics << std::dec << "\n";
+
+      static_assert(GasSchedule::log <= 65536, "Gas cost of log could lead to overflow");
+      static_assert(GasSchedule::logTopic <= 65536, "Gas cost of logTopic could lead to overflow");
+      static_assert(GasSchedule::logData <= 65536, "Gas cost of logData could lead to overflow");
+      // Using uint64_t to force a type issue if the underlying API changes.
+      takeInterfaceGas(GasSchedule::log + (GasSchedule::logTopic * numberOfTopics) + (GasSchedule::logData * int64_t(length)));
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "log");
+
+      ensureCondition(numberOfTopics <= 4, ContractValidationFailure, "Too many topics specified");
+
+      // TODO: should this assert that unused topic offsets must be 0?
+      std::array<evmc::uint256be, 4> topics;
+      topics[0] = (numberOfTopics >= 1) ? loadBytes32(topic1) : evmc::uint256be{};
+      topics[1] = (numberOfTopics >= 2) ? loadBytes32(topic2) : evmc::uint256be{};
+      topics[2] = (numberOfTopics >= 3) ? loadBytes32(topic3) : evmc::uint256be{};
+      topics[3] = (numberOfTopics == 4) ? loadBytes32(topic4) : evmc::uint256be{};
+
+      // The data is passed in place, the host copies it.
+      ensureSourceMemoryBounds(dataOffset, length);
+      uint8_t const* data = length ? derived().memoryPointer(dataOffset, length) : nullptr;
+
+      if (m_bufferLogs) {
+        m_logs.push_back({m_logData.size(), length, topics, numberOfTopics});
+        if (length)
+          m_logData.append(data, length);
+        return;
+      }
+
+      m_host.emit_log(m_msg.recipient, data, length, topics.data(), numberOfTopics);
+  }
+
+  template <typename Derived>
+  int64_t EthereumInterface<Derived>::eeiGetBlockNumber()
+  {
+      HERA_DEBUG << depthToString() << " getBlockNumber\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      static_assert(std::is_same<decltype(m_host.get_tx_context().block_number), int64_t>::value, "int64_t type expected");
+
+      return m_host.get_tx_context().block_number;
+  }
+
+  template <typename Derived>
+  int64_t EthereumInterface<Derived>::eeiGetBlockTimestamp()
+  {
+      HERA_DEBUG << depthToString() << " getBlockTimestamp\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      static_assert(std::is_same<decltype(m_host.get_tx_context().block_timestamp), int64_t>::value, "int64_t type expected");
+
+      return m_host.get_tx_context().block_timestamp;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiGetTxOrigin(uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " getTxOrigin " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      storeAddress(m_host.get_tx_context().tx_origin, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiStorageStore(uint32_t pathOffset, uint32_t valueOffset)
+  {
+      HERA_DEBUG << depthToString() << " storageStore " << std::hex << pathOffset << " " << valueOffset << std::dec << "\n";
+
+      static_assert(
+        GasSchedule::storageStoreCreate >= GasSchedule::storageStoreChange,
+        "storageStoreChange costs more than storageStoreCreate"
+      );
+
+      // Charge this here as it is the minimum cost.
+      takeInterfaceGas(GasSchedule::storageStoreChange);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "storageStore");
+
+      const auto path = loadBytes32(pathOffset);
+      const auto value = loadBytes32(valueOffset);
+      StorageSlot& slot = storageSlot(path);
+
+      // Charge the right amount in case of the create case.
+      if (is_zero(slot.current) && !is_zero(value))
+        takeInterfaceGas(GasSchedule::storageStoreCreate - GasSchedule::storageStoreChange);
+
+      // We do not need to take care about the delete case (gas refund), the client does it.
+      // Hence clearing a slot is always written through, after any buffered value,
+      // so that the client sees every deletion it would have seen otherwise.
+      bool const deletes = is_zero(value) && !is_zero(slot.current);
+      if (m_writeBack && !deletes) {
+        slot.current = value;
+        slot.dirty = true;
+        return;
+      }
+
+      if (slot.dirty && slot.current != slot.stored)
+        m_host.set_storage(m_msg.recipient, path, slot.current);
+      m_host.set_storage(m_msg.recipient, path, value);
+      slot.stored = value;
+      slot.current = value;
+      slot.dirty = false;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiStorageLoad(uint32_t pathOffset, uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " storageLoad " << std::hex << pathOffset << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::storageLoad);
+
+      evmc::bytes32 path = loadBytes32(pathOffset);
+
+      storeBytes32(storageSlot(path).current, resultOffset);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size)
+  {
+      HERA_DEBUG << depthToString() << " " << (revert ? "revert " : "finish ") << std::hex << offset << " " << size << std::dec << "\n";
+
+      ensureSourceMemoryBounds(offset, size);
+      // This is the only copy of the output, the buffer is handed over to the client.
+      m_result.returnValue = OutputBuffer{size};
+      loadMemory(offset, m_result.returnValue.data(), size);
+
+      m_result.isRevert = revert;
+
+      throw EndExecution{};
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiGetReturnDataSize()
+  {
+      HERA_DEBUG << depthToString() << " getReturnDataSize\n";
+
+      takeInterfaceGas(GasSchedule::base);
+
+      return static_cast<uint32_t>(m_lastReturnData.size());
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiReturnDataCopy(uint32_t dataOffset, uint32_t offset, uint32_t size)
+  {
+      HERA_DEBUG << depthToString() << " returnDataCopy " << std::hex << dataOffset << " " << offset << " " << size << std::dec << "\n";
+
+      safeChargeDataCopy(size, GasSchedule::verylow);
+
+      storeMemory(m_lastReturnData, offset, dataOffset, size);
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiCall(EEICallKind kind, int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength)
+  {
+      ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
+
+      evmc_message call_message;
+      call_message.recipient = loadAddress(addressOffset);
+      call_message.flags = m_msg.flags & EVMC_STATIC;
+      call_message.depth = m_msg.depth + 1;
+
+      switch (kind) {
+      case EEICallKind::Call:
+      case EEICallKind::CallCode:
+        call_message.kind = (kind == EEICallKind::CallCode) ? EVMC_CALLCODE : EVMC_CALL;
+        call_message.sender = m_msg.recipient;
+        call_message.value = loadUint128(valueOffset);
+
+        if ((kind == EEICallKind::Call) && !evmc::is_zero(call_message.value)) {
+          ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "call");
+        }
+        break;
+      case EEICallKind::CallDelegate:
+        call_message.kind = EVMC_DELEGATECALL;
+        call_message.sender = m_msg.sender;
+        call_message.value = m_msg.value;
+        break;
+      case EEICallKind::CallStatic:
+        call_message.kind = EVMC_CALL;
+        call_message.flags |= EVMC_STATIC;
+        call_message.sender = m_msg.recipient;
+        call_message.value = {};
+        break;
+      }
+
+#if HERA_DEBUGGING
+      std::string methodName;
+      switch (kind) {
+      case EEICallKind::Call: methodName = "call"; break;
+      case EEICallKind::CallCode: methodName = "callCode"; break;
+      case EEICallKind::CallDelegate: methodName = "callDelegate"; break;
+      case EEICallKind::CallStatic: methodName = "callStatic"; break;
+      }
+
+      HERA_DEBUG <<
+        depthToString() << " " <<
+        methodName << " " << std::hex <<
+        gas << " " <<
+        addressOffset << " " <<
+        valueOffset << " " <<
+        dataOffset << " " <<
+        dataLength << std::dec << "\n";
+#endif
+
+      // The input is passed in place, as the memory cannot change until the call returns.
+      if (dataLength) {
+        ensureSourceMemoryBounds(dataOffset, dataLength);
+        call_message.input_data = derived().memoryPointer(dataOffset, dataLength);
+        call_message.input_size = dataLength;
+      } else {
+        call_message.input_data = nullptr;
+        call_message.input_size = 0;
+      }
+
+      // Start with base call gas
+      takeInterfaceGas(GasSchedule::call);
+
+      if (m_msg.depth >= 1024)
+        return 1;
+
+      // These checks are in EIP150 but not in the YellowPaper
+      // Charge valuetransfer gas if value is being transferred.
+      if ((kind == EEICallKind::Call || kind == EEICallKind::CallCode) && !evmc::is_zero(call_message.value)) {
+        takeInterfaceGas(GasSchedule::valuetransfer);
+
+        if (!enoughSenderBalanceFor(call_message.value))
+          return 1;
+
+        // Only charge callNewAccount gas if the account is new and non-zero value is being transferred per EIP161.
+        if ((kind == EEICallKind::Call) && !m_host.account_exists(call_message.recipient))
+          takeInterfaceGas(GasSchedule::callNewAccount);
+      }
+
+      // This is the gas we are forwarding to the callee.
+      // Retain one 64th of it as per EIP150
+      gas = std::min(gas, maxCallGas(m_result.gasLeft));
+
+      takeInterfaceGas(gas);
+
+      // Add gas stipend for value transfers
+      if (!evmc::is_zero(call_message.value))
+        gas += GasSchedule::valueStipend;
+
+      call_message.gas = gas;
+
+      flushBuffers();
+      auto call_result = m_host.call(call_message);
+      // The callee may have changed our storage, i.e. by reentrancy or via callcode/delegatecall.
+      m_storage.clear();
+
+      /* Return unspent gas */
+      heraAssert(call_result.gas_left >= 0, "EVMC returned negative gas left");
+      m_result.gasLeft += call_result.gas_left;
+
+      evmc_status_code const status = call_result.status_code;
+      keepReturnData(std::move(call_result));
+
+      switch (status) {
+      case EVMC_SUCCESS:
+        return 0;
+      case EVMC_REVERT:
+        return 2;
+      default:
+        return 1;
+      }
+  }
+
+  template <typename Derived>
+  uint32_t EthereumInterface<Derived>::eeiCreate(uint32_t valueOffset, uint32_t dataOffset, uint32_t length, uint32_t resultOffset)
+  {
+      HERA_DEBUG << depthToString() << " create " << std::hex << valueOffset << " " << dataOffset << " " << length << std::dec << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::create);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "create");
+
+      evmc_message create_message;
+
+      create_message.recipient = {};
+      create_message.sender = m_msg.recipient;
+      create_message.value = loadUint128(valueOffset);
+
+      if (m_msg.depth >= 1024)
+        return 1;
+      if (!enoughSenderBalanceFor(create_message.value))
+        return 1;
+
+      // The code is passed in place, as the memory cannot change until the call returns.
+      if (length) {
+        ensureSourceMemoryBounds(dataOffset, length);
+        create_message.input_data = derived().memoryPointer(dataOffset, length);
+        create_message.input_size = length;
+      } else {
+        create_message.input_data = nullptr;
+        create_message.input_size = 0;
+      }
+
+      create_message.depth = m_msg.depth + 1;
+      create_message.kind = EVMC_CREATE;
+      create_message.flags = 0;
+
+      int64_t gas = maxCallGas(m_result.gasLeft);
+      create_message.gas = gas;
+      takeInterfaceGas(gas);
+
+      flushBuffers();
+      auto create_result = m_host.call(create_message);
+      // The init code may have called back into this account.
+      m_storage.clear();
+
+      /* Return unspent gas */
+      heraAssert(create_result.gas_left >= 0, "EVMC returned negative gas left");
+      m_result.gasLeft += create_result.gas_left;
+
+      evmc_status_code const status = create_result.status_code;
+      if (status == EVMC_SUCCESS) {
+        storeAddress(create_result.create_address, resultOffset);
+        clearReturnData();
+      } else {
+        keepReturnData(std::move(create_result));
+      }
+
+      switch (status) {
+      case EVMC_SUCCESS:
+        return 0;
+      case EVMC_REVERT:
+        return 2;
+      default:
+        return 1;
+      }
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::eeiSelfDestruct(uint32_t addressOffset)
+  {
+      HERA_DEBUG << depthToString() << " selfDestruct " << std::hex << addressOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule::selfdestruct);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "selfDestruct");
+
+      evmc::address address = loadAddress(addressOffset);
+
+      if (!m_host.account_exists(address))
+        takeInterfaceGas(GasSchedule::callNewAccount);
+
+      flushBuffers();
+      m_host.selfdestruct(m_msg.recipient, address);
+
+      throw EndExecution{};
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::takeGas(int64_t gas)
+  {
+    // NOTE: gas >= 0 is validated by the callers of this method
+    ensureCondition(gas <= m_result.gasLeft, OutOfGas, "Out of gas.");
+    m_result.gasLeft -= gas;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::takeInterfaceGas(int64_t gas)
+  {
+    if (!m_meterGas)
+      return;
+    heraAssert(gas >= 0, "Trying to take negative gas.");
+    takeGas(gas);
+  }
+
+  /*
+   * Memory Operations
+   */
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::ensureSourceMemoryBounds(uint32_t offset, uint32_t length) {
+    ensureCondition((offset + length) >= offset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (offset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length)
+  {
+    // NOTE: the source bound check is not needed as the caller already ensures it
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory load from offset 0x" << std::hex << srcOffset << std::dec << "\n";
+
+    if (length > 0) {
+      uint8_t const* src = derived().memoryPointer(srcOffset, length);
+      std::reverse_copy(src, src + length, dst);
+    }
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length)
+  {
+    // NOTE: the source bound check is not needed as the caller already ensures it
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory load from offset 0x" << std::hex << srcOffset << std::dec << "\n";
+
+    // The pointer is only valid for a non-empty range.
+    if (length > 0)
+      memcpy(dst, derived().memoryPointer(srcOffset, length), length);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeMemoryReverse(const uint8_t *src, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    if (length > 0)
+      std::reverse_copy(src, src + length, derived().memoryPointer(dstOffset, length));
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeMemory(const uint8_t *src, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    if (length > 0)
+      memcpy(derived().memoryPointer(dstOffset, length), src, length);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeMemory(bytes_view src, uint32_t srcOffset, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(src.size() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    if (length > 0)
+      memcpy(derived().memoryPointer(dstOffset, length), src.data() + srcOffset, length);
+  }
+
+  /*
+   * Memory Op Wrapper Functions
+   */
+
+  template <typename Derived>
+  evmc::bytes32 EthereumInterface<Derived>::loadBytes32(uint32_t srcOffset)
+  {
+    evmc::bytes32 dst;
+    loadMemory(srcOffset, dst.bytes, 32);
+    return dst;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeBytes32(evmc::uint256be const& src, uint32_t dstOffset)
+  {
+    storeMemory(src.bytes, dstOffset, 32);
+  }
+
+  template <typename Derived>
+  evmc::uint256be EthereumInterface<Derived>::loadUint256(uint32_t srcOffset)
+  {
+    evmc::uint256be dst;
+    loadMemoryReverse(srcOffset, dst.bytes, 32);
+    return dst;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeUint256(evmc::uint256be const& src, uint32_t dstOffset)
+  {
+    storeMemoryReverse(src.bytes, dstOffset, 32);
+  }
+
+  template <typename Derived>
+  evmc::address EthereumInterface<Derived>::loadAddress(uint32_t srcOffset)
+  {
+    evmc::address dst;
+    loadMemory(srcOffset, dst.bytes, 20);
+    return dst;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeAddress(evmc::address const& src, uint32_t dstOffset)
+  {
+    storeMemory(src.bytes, dstOffset, 20);
+  }
+
+  template <typename Derived>
+  evmc::uint256be EthereumInterface<Derived>::loadUint128(uint32_t srcOffset)
+  {
+    evmc::uint256be dst;
+    loadMemoryReverse(srcOffset, dst.bytes + 16, 16);
+    return dst;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::storeUint128(evmc::uint256be const& src, uint32_t dstOffset)
+  {
+    ensureCondition(!exceedsUint128(src), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
+    storeMemoryReverse(src.bytes + 16, dstOffset, 16);
+  }
+
+  /*
+   * Utilities
+   */
+  template <typename Derived>
+  void EthereumInterface<Derived>::safeChargeDataCopy(uint32_t length, unsigned baseCost) {
+    takeInterfaceGas(baseCost);
+
+    // Since length here is 32 bits divided by 32 (aka shifted right by 5 bits), we
+    // can assume the upper bound for values is 27 bits.
+    //
+    // Since `gas` is 63 bits wide, that means we have an extra 36 bits of headroom.
+    //
+    // Allow 16 bits here.
+    static_assert(GasSchedule::copy <= 65536, "Gas cost of copy could lead to overflow");
+    // Using uint64_t to force a type issue if the underlying API changes.
+    takeInterfaceGas(GasSchedule::copy * ((int64_t(length) + 31) / 32));
+  }
+
+  template <typename Derived>
+  bool EthereumInterface<Derived>::enoughSenderBalanceFor(evmc::uint256be const& value)
+  {
+    evmc::uint256be balance = m_host.get_balance(m_msg.recipient);
+    return safeLoadUint128(balance) >= safeLoadUint128(value);
+  }
+
+  template <typename Derived>
+  typename EthereumInterface<Derived>::StorageSlot& EthereumInterface<Derived>::storageSlot(evmc::bytes32 const& path)
+  {
+    auto it = m_storage.find(path);
+    if (it == m_storage.end()) {
+      evmc::bytes32 const value = m_host.get_storage(m_msg.recipient, path);
+      it = m_storage.emplace(path, StorageSlot{value, value}).first;
+    }
+    return it->second;
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::flushStorage()
+  {
+    for (auto& entry: m_storage) {
+      StorageSlot& slot = entry.second;
+      // Slots set back to the value held by the host need no write.
+      if (slot.dirty && slot.current != slot.stored) {
+        m_host.set_storage(m_msg.recipient, entry.first, slot.current);
+        slot.stored = slot.current;
+      }
+      slot.dirty = false;
+    }
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::flushLogs()
+  {
+    for (BufferedLog const& log: m_logs) {
+      uint8_t const* data = log.dataSize ? &m_logData[log.dataOffset] : nullptr;
+      m_host.emit_log(m_msg.recipient, data, log.dataSize, log.topics.data(), log.numTopics);
+    }
+    // The capacity is kept for subsequent logs.
+    m_logs.clear();
+    m_logData.clear();
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::keepReturnData(evmc::Result&& result) noexcept
+  {
+    if (result.output_data)
+      m_lastReturnData = bytes_view{result.output_data, result.output_size};
+    else
+      m_lastReturnData = {};
+    // Moving the result does not move its output, hence the view stays valid.
+    m_lastResult = std::move(result);
+  }
+
+  template <typename Derived>
+  void EthereumInterface<Derived>::clearReturnData() noexcept
+  {
+    m_lastReturnData = {};
+    m_lastResult = evmc::Result{evmc_result{}};
+  }
+
+  template <typename Derived>
+  unsigned __int128 EthereumInterface<Derived>::safeLoadUint128(evmc::uint256be const& value)
+  {
+    ensureCondition(!exceedsUint128(value), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
+    unsigned __int128 ret = 0;
+    for (unsigned i = 16; i < 32; i++) {
+      ret <<= 8;
+      ret |= value.bytes[i];
+    }
+    return ret;
+  }
+}
@@ -16,26 +16,32 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <evmc/evmc.h>
 #include <evmc/evmc.hpp>
 
 #include "exceptions.h"
 #include "helpers.h"
+#include "host.h"
+#include "output.h"
 
 namespace hera {
 
 struct ExecutionResult {
   int64_t gasLeft = 0;
-  bytes returnValue;
+  OutputBuffer returnValue;
   bool isRevert = false;
 };
 
-// There is a single engine instance in each VM instance and
-// likely execute() is called multiple times. As a result
+// There is an engine instance per executing thread in each VM instance
+// and likely execute() is called multiple times. As a result
 // an engine implementation cannot have instance variables with
 // side-effects.
 class WasmEngine {
@@ -47,11 +53,17 @@ public:
     bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
   ) = 0;
 
   virtual void verifyContract(bytes_view code) = 0;
 
+  /// Prepares the code for execution ahead of time, by loading it into the
+  /// caches of the engine. Throws ContractValidationFailure if the code is invalid.
+  virtual void prepareContract(bytes_view code) { verifyContract(code); }
+
   static void enableBenchmarking() noexcept { benchmarkingEnabled = true; }
 
 protected:
@@ -77,11 +89,17 @@ private:
   void collectBenchmarkingData();
 
   using clock = std::chrono::high_resolution_clock;
-  static bool benchmarkingEnabled;
+  static std::atomic<bool> benchmarkingEnabled;
   clock::time_point instantiationStartTime;
   clock::time_point executionStartTime;
 };
 
+/// The EEI on top of the memory of an engine.
+///
+/// Derived is the engine specific interface, which provides memorySize() and
+/// memoryPointer(offset, length). These are called statically, hence inlined
+/// into every EEI method. The definitions are in eei-impl.h.
+template <typename Derived>
 class EthereumInterface {
 public:
   explicit EthereumInterface(
@@ -89,13 +107,17 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult& _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _writeBack,
+    bool _bufferLogs
   ):
     m_host{_host}, // FIXME: Change param to &.
     m_code{_code},
     m_msg(_msg),
     m_result(_result),
-    m_meterGas(_meterGas)
+    m_meterGas(_meterGas),
+    m_writeBack(_writeBack),
+    m_bufferLogs(_bufferLogs)
   {
     heraAssert((m_msg.flags & ~uint32_t(EVMC_STATIC)) == 0, "Unknown flags not supported.");
 
@@ -106,17 +128,20 @@ public:
     m_result.isRevert = false;
   }
 
+  /// To be called by the engine when the contract has returned or ended execution
+  /// without trapping. Hands the buffered storage writes and logs to the host, unless reverted.
+  void executionCompleted()
+  {
+    if (!m_result.isRevert)
+      flushBuffers();
+  }
+
 // WAVM/WABT host functions access this interface through an instance,
 // which requires public methods.
 // TODO: update upstream WAVM/WABT to have a context (user data) passed down.
 #if HERA_WAVM == 0 && HERA_WABT == 0
 protected:
 #endif
-  virtual size_t memorySize() const = 0 ;
-  virtual void memorySet(size_t offset, uint8_t value) = 0;
-  virtual uint8_t memoryGet(size_t offset) = 0;
-  virtual uint8_t* memoryPointer(size_t offset, size_t length) = 0;
-
   enum class EEICallKind {
     Call,
     CallCode,
@@ -166,6 +191,9 @@ protected:
   void eeiSelfDestruct(uint32_t addressOffset);
 
 private:
+  Derived& derived() noexcept { return static_cast<Derived&>(*this); }
+  Derived const& derived() const noexcept { return static_cast<Derived const&>(*this); }
+
   void eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size);
 
   // Helpers methods
@@ -179,7 +207,6 @@ private:
   void ensureSourceMemoryBounds(uint32_t offset, uint32_t length);
   void loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length);
-  void loadMemory(uint32_t srcOffset, bytes& dst, size_t length);
   void storeMemoryReverse(const uint8_t *src, uint32_t dstOffset, uint32_t length);
   void storeMemory(const uint8_t *src, uint32_t dstOffset, uint32_t length);
   void storeMemory(bytes_view src, uint32_t srcOffset, uint32_t dstOffset, uint32_t length);
@@ -200,14 +227,57 @@ private:
 
   bool enoughSenderBalanceFor(evmc::uint256be const& value);
 
+  /// A storage slot of the executing account, as seen by this execution.
+  struct StorageSlot {
+    /// The value held by the host, as loaded or last written.
+    evmc::bytes32 stored;
+    evmc::bytes32 current;
+    /// Whether the current value is yet to be written back to the host.
+    bool dirty = false;
+  };
+
+  /// @returns the cached slot at @path, loading it from the host on first access.
+  StorageSlot& storageSlot(evmc::bytes32 const& path);
+  /// Writes the buffered storage writes back to the host.
+  void flushStorage();
+  /// Emits the buffered logs in order.
+  void flushLogs();
+  /// Hands everything buffered to the host, before it may be observed.
+  void flushBuffers()
+  {
+    flushStorage();
+    flushLogs();
+  }
+
+  /// A log kept until the execution calls out or ends, with its data in m_logData.
+  struct BufferedLog {
+    size_t dataOffset;
+    size_t dataSize;
+    std::array<evmc::bytes32, 4> topics;
+    size_t numTopics;
+  };
+
+  /// Keeps @result of a call or create, its output becoming the return data.
+  void keepReturnData(evmc::Result&& result) noexcept;
+  void clearReturnData() noexcept;
+
   static unsigned __int128 safeLoadUint128(evmc::uint256be const& value);
 
-  evmc::HostContext& m_host;
+  CachingHost m_host;
   bytes_view m_code;
   evmc_message const& m_msg;
-  bytes m_lastReturnData;
+  // The result of the last call or create owns the buffer viewed by m_lastReturnData.
+  evmc::Result m_lastResult{evmc_result{}};
+  bytes_view m_lastReturnData;
+  // The storage slots accessed so far, dropped whenever a call or create may have changed them.
+  std::unordered_map<evmc::bytes32, StorageSlot> m_storage;
+  // The buffered logs, their data being stored back to back.
+  std::vector<BufferedLog> m_logs;
+  bytes m_logData;
   ExecutionResult & m_result;
   bool m_meterGas = true;
+  bool m_writeBack = false;
+  bool m_bufferLogs = false;
 };
 
 struct GasSchedule {
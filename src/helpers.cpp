@@ -15,8 +15,11 @@
  */
 
 #include <fstream>
+#include <functional>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <string_view>
 
 #include "helpers.h"
 
@@ -84,6 +87,22 @@ bytes parseHexString(const string& input) {
   return ret;
 }
 
+bool parseDecimal(string const& input, size_t& output) {
+  if (input.empty())
+    return false;
+  size_t ret = 0;
+  for (char c: input) {
+    if (c < '0' || c > '9')
+      return false;
+    size_t digit = static_cast<size_t>(c - '0');
+    if (ret > (numeric_limits<size_t>::max() - digit) / 10)
+      return false;
+    ret = ret * 10 + digit;
+  }
+  output = ret;
+  return true;
+}
+
 bool hasWasmPreamble(bytes_view _input) {
   return
     _input.size() >= 8 &&
@@ -102,4 +121,8 @@ bool hasWasmVersion(bytes_view _input, uint8_t _version) {
     _input[7] == 0;
 }
 
+size_t codeHash(bytes_view code) noexcept {
+  return hash<string_view>{}({reinterpret_cast<char const*>(code.data()), code.size()});
+}
+
 }
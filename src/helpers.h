@@ -34,8 +34,15 @@ std::string bytesAsHexStr(bytes_view bytes);
 
 bytes parseHexString(std::string const& input);
 
+// Parses a decimal number. Returns false if the input is invalid or out of range.
+bool parseDecimal(std::string const& input, size_t& output);
+
 bool hasWasmPreamble(bytes_view _input);
 
 bool hasWasmVersion(bytes_view _input, uint8_t _version);
 
+// Returns a non-cryptographic hash of the code, stable within a build.
+// Suitable as a cache key only if the full code is compared on lookup.
+size_t codeHash(bytes_view code) noexcept;
+
 }
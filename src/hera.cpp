@@ -16,21 +16,28 @@
 
 #include <hera/hera.h>
 
+#include <atomic>
 #include <limits>
 #include <cstring>
 #include <unistd.h>
+#include <future>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <evmc/evmc.hpp>
 
+#include "cache.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "host.h"
 #if HERA_BINARYEN
 #include "binaryen.h"
+#include "memory.h"
 #endif
 #if HERA_WAVM
 #include "wavm.h"
@@ -38,6 +45,9 @@
 #if HERA_WABT
 #include "wabt.h"
 #endif
+#if HERA_WAVM && (HERA_BINARYEN || HERA_WABT)
+#include "tiered.h"
+#endif
 
 #include <hera/buildinfo.h>
 
@@ -72,9 +82,12 @@ const map<string, WasmEngineCreateFn> wasm_engine_map {
 #if HERA_WABT
   { "wabt", WabtEngine::create },
 #endif
+#if HERA_WAVM && (HERA_BINARYEN || HERA_WABT)
+  { "tiered", TieredEngine::create },
+#endif
 };
 
-WasmEngineCreateFn wasmEngineCreateFn =
+const WasmEngineCreateFn defaultEngineCreateFn =
 // This is the order of preference.
 #if HERA_BINARYEN
     BinaryenEngine::create
@@ -87,20 +100,276 @@ WasmEngineCreateFn wasmEngineCreateFn =
 #endif
 ;
 
+using namespace evmc::literals;
+
+constexpr auto sentinelAddress = 0x000000000000000000000000000000000000000a_address;
+constexpr auto evm2wasmAddress = 0x000000000000000000000000000000000000000b_address;
+constexpr auto runevmAddress = 0x000000000000000000000000000000000000000c_address;
+
+// Memoized outputs of a system contract transforming code (such as the Sentinel),
+// keyed by the input code. Only successful transformations are cached.
+//
+// Outputs are only valid for the code of the system contract: its override if set,
+// otherwise the contract deployed at its address, identified by the code hash reported
+// by the host, since the client may upgrade it without Hera changing. Outputs are
+// dropped when the code changes, and persisted outputs are tagged with it.
+struct SystemContractCache {
+  SystemContractCache(evmc::address const& _address, string _name):
+    address(_address),
+    name(move(_name))
+  {}
+
+  evmc::address const address;
+  string const name;
+  CodeCache<bytes const> results{1024, 64 * 1024 * 1024};
+
+  // Guards the members below, which are set by resetSystemContractCache().
+  mutex codeMutex;
+  string cacheDirectory;
+  // Whether the code is overridden, otherwise the caches follow the code hash.
+  bool overridden = false;
+  bool codeHashKnown = false;
+  evmc::bytes32 codeHash;
+  // Incremented whenever the results are dropped.
+  uint64_t generation = 0;
+  // Persists the results across restarts, if enabled.
+  shared_ptr<DiskCache const> disk;
+};
+
+// Marks the engines created for an engine selection of an instance.
+struct EngineSelection {};
+
+// An engine owned by an executing thread. It is only used while its selection is alive.
+struct ThreadEngine {
+  EngineSelection const* key;
+  weak_ptr<EngineSelection const> selection;
+  unique_ptr<WasmEngine> engine;
+};
+
+// An instance can be used by several threads at once, but options must not be set
+// while executing.
 struct hera_instance : evmc_vm {
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
+  WasmEngineCreateFn createEngine = defaultEngineCreateFn;
+  // Identifies the engines created for this instance and engine selection.
+  // Replaced when the engine changes, which invalidates the engines of every thread.
+  shared_ptr<EngineSelection const> engineSelection = make_shared<EngineSelection const>();
   hera_evm1mode evm1mode = hera_evm1mode::reject;
   bool metering = false;
+  // Buffers the storage writes of an execution until it calls out or ends,
+  // coalescing the writes to the same slot.
+  bool storageWriteBack = false;
+  // Buffers the logs of an execution until it calls out or ends, so that
+  // the logs of failing executions never reach the client.
+  bool logBuffering = false;
   map<evmc::address, bytes> contract_preload_list;
+  string cacheDirectory;
+  SystemContractCache sentinelCache{sentinelAddress, "sentinel"};
+  SystemContractCache evm2wasmCache{evm2wasmAddress, "evm2wasm"};
+  // The output of runevm, computed on first use. Accessed atomically.
+  shared_ptr<bytes const> runevmInterpreter;
+  // Prepare preloaded contracts on a background thread.
+  bool asyncPreparation = false;
+  // The last preparation started in the background. Each one waits for the previous.
+  // The flag lets executions skip the mutex once the preparations have finished.
+  atomic<bool> preparationPending{false};
+  mutex preparationMutex;
+  future<void> pendingPreparation;
+
+  // Returns the engine of the calling thread, creating it on first use.
+  // The engines are owned by the thread, so no lock is taken and they are freed on thread exit.
+  WasmEngine& engine()
+  {
+    thread_local vector<ThreadEngine> threadEngines;
+    ThreadEngine* found = nullptr;
+    for (auto it = threadEngines.begin(); it != threadEngines.end();) {
+      // Engines of destroyed instances or replaced engine selections are dropped.
+      if (it->selection.expired()) {
+        it = threadEngines.erase(it);
+        continue;
+      }
+      if (it->key == engineSelection.get())
+        found = &*it;
+      ++it;
+    }
+    if (!found) {
+      threadEngines.push_back({engineSelection.get(), engineSelection, createEngine()});
+      found = &threadEngines.back();
+    }
+    return *found->engine;
+  }
 
   hera_instance() noexcept : evmc_vm({EVMC_ABI_VERSION, "hera", hera_get_buildinfo()->project_version, nullptr, nullptr, nullptr, nullptr}) {}
 };
 
-using namespace evmc::literals;
+string systemContractTag()
+{
+  return string("hera-") + hera_get_buildinfo()->project_version;
+}
 
-constexpr auto sentinelAddress = 0x000000000000000000000000000000000000000a_address;
-constexpr auto evm2wasmAddress = 0x000000000000000000000000000000000000000b_address;
-constexpr auto runevmAddress = 0x000000000000000000000000000000000000000c_address;
+// Drops the memoized results of a system contract, to be called whenever it may have changed.
+void resetSystemContractCache(hera_instance const& hera, SystemContractCache& cache)
+{
+  lock_guard<mutex> lock{cache.codeMutex};
+  cache.results.clear();
+  ++cache.generation;
+  cache.cacheDirectory = hera.cacheDirectory;
+  cache.codeHashKnown = false;
+  cache.disk.reset();
+
+  auto preload = hera.contract_preload_list.find(cache.address);
+  cache.overridden = preload != hera.contract_preload_list.end();
+  // The full code is part of the tag, as its (non-cryptographic) hash could collide.
+  if (cache.overridden && !cache.cacheDirectory.empty()) {
+    string tag = systemContractTag() + "-override-";
+    tag.append(reinterpret_cast<char const*>(preload->second.data()), preload->second.size());
+    cache.disk = make_shared<DiskCache const>(cache.cacheDirectory, cache.name, move(tag));
+  }
+}
+
+void resetSystemContractCaches(hera_instance& hera)
+{
+  resetSystemContractCache(hera, hera.sentinelCache);
+  resetSystemContractCache(hera, hera.evm2wasmCache);
+  atomic_store(&hera.runevmInterpreter, shared_ptr<bytes const>{});
+}
+
+// The caches of a system contract for its current code.
+struct SystemContractCode {
+  shared_ptr<DiskCache const> disk;
+  uint64_t generation;
+};
+
+// Drops the memoized results of a system contract if the host reports a different code.
+SystemContractCode checkSystemContractCode(SystemContractCache& cache, evmc::HostContext& host)
+{
+  lock_guard<mutex> lock{cache.codeMutex};
+  if (!cache.overridden) {
+    evmc::bytes32 const codeHash = host.get_code_hash(cache.address);
+    if (!cache.codeHashKnown || codeHash != cache.codeHash) {
+      if (cache.codeHashKnown)
+        HERA_DEBUG << "The " << cache.name << " contract has changed, dropping its memoized outputs\n";
+      cache.results.clear();
+      ++cache.generation;
+      cache.codeHash = codeHash;
+      cache.codeHashKnown = true;
+      cache.disk.reset();
+      if (!cache.cacheDirectory.empty())
+        cache.disk = make_shared<DiskCache const>(cache.cacheDirectory, cache.name, systemContractTag() + "-" + toHex(codeHash));
+    }
+  }
+  return {cache.disk, cache.generation};
+}
+
+// Returns the memoized output of a system contract for @input,
+// or calls @transform and memoizes its output.
+// The output is shared with the cache rather than copied.
+template <typename Transform>
+shared_ptr<bytes const> memoizedSystemContractCall(
+  SystemContractCache& cache,
+  evmc::HostContext& host,
+  bytes_view input,
+  Transform transform
+) {
+  SystemContractCode const code = checkSystemContractCode(cache, host);
+  shared_ptr<DiskCache const> const& disk = code.disk;
+
+  if (auto cached = cache.results.find(input)) {
+    HERA_DEBUG << "Using memoized system contract output (" << cached->size() << " bytes)\n";
+    return cached;
+  }
+
+  shared_ptr<bytes const> ret;
+  DiskCacheEntry persisted;
+  if (disk)
+    persisted = disk->load(input);
+
+  if (persisted) {
+    HERA_DEBUG << "Using persisted system contract output (" << persisted.value().size() << " bytes)\n";
+    ret = make_shared<bytes const>(persisted.value());
+  } else {
+    ret = make_shared<bytes const>(transform(input));
+    if (disk)
+      disk->store(input, *ret);
+  }
+
+  // Not memoized if the code changed in the meantime, as the output may be stale.
+  lock_guard<mutex> lock{cache.codeMutex};
+  if (cache.generation != code.generation)
+    return ret;
+  return cache.results.insert(input, ret, input.size() + ret->size());
+}
+
+// Loads a preloaded contract into the caches of the engine, so that the first
+// execution does not pay for parsing, validation and compilation.
+// @returns false if the contract is invalid.
+bool prepareSystemContract(WasmEngine& engine, bytes_view code) noexcept
+{
+  try {
+    engine.prepareContract(code);
+    return true;
+  } catch (exception const& e) {
+    HERA_DEBUG << "Invalid system contract: " << e.what() << "\n";
+  } catch (...) {
+    HERA_DEBUG << "Invalid system contract\n";
+  }
+  return false;
+}
+
+// Checks a preloaded contract whose preparation is left to the background.
+// @returns false if the contract is invalid.
+bool verifySystemContract(WasmEngine& engine, bytes_view code) noexcept
+{
+  try {
+    engine.verifyContract(code);
+    return true;
+  } catch (exception const& e) {
+    HERA_DEBUG << "Invalid system contract: " << e.what() << "\n";
+  } catch (...) {
+    HERA_DEBUG << "Invalid system contract\n";
+  }
+  return false;
+}
+
+// Prepares a preloaded contract on a background thread with a new engine instance.
+// The preparations are serialised, as the engines may not support concurrent compilation.
+void prepareSystemContractInBackground(hera_instance& hera, bytes code)
+{
+  hera.preparationPending = true;
+  hera.pendingPreparation = async(
+    launch::async,
+    [previous = move(hera.pendingPreparation), createFn = hera.createEngine, code = move(code)]() mutable {
+      if (previous.valid())
+        previous.wait();
+      unique_ptr<WasmEngine> engine = createFn();
+      prepareSystemContract(*engine, code);
+    }
+  );
+}
+
+// Prepares every preloaded WebAssembly contract for the selected engine.
+// Invalid contracts are reported at execution time.
+void prepareSystemContracts(hera_instance& hera)
+{
+  for (auto const& preload: hera.contract_preload_list) {
+    if (!hasWasmPreamble(preload.second))
+      continue;
+    if (hera.asyncPreparation)
+      prepareSystemContractInBackground(hera, preload.second);
+    else
+      prepareSystemContract(hera.engine(), preload.second);
+  }
+}
+
+// The engines are not prepared for contracts being compiled concurrently to execution.
+void waitForPreparation(hera_instance& hera)
+{
+  if (!hera.preparationPending.load(memory_order_acquire))
+    return;
+  lock_guard<mutex> lock{hera.preparationMutex};
+  if (hera.pendingPreparation.valid())
+    hera.pendingPreparation.get();
+  hera.preparationPending.store(false, memory_order_release);
+}
 
 // Calls a system contract at @address with input data @input.
 // It is a "staticcall" with sender 000...000 and no value.
@@ -137,6 +406,7 @@ pair<evmc_status_code, bytes> callSystemContract(
 }
 
 pair<evmc_status_code, bytes> locallyExecuteSystemContract(
+  WasmEngine& engine,
   evmc::HostContext& context,
   evmc::address const& address,
   int64_t & gas,
@@ -158,14 +428,13 @@ pair<evmc_status_code, bytes> locallyExecuteSystemContract(
     .code_address = address,
   };
 
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
   // TODO: should we catch exceptions here?
-  ExecutionResult result = engine->execute(context, code, state_code, message, false);
+  ExecutionResult result = engine.execute(context, code, state_code, message, false, false, false);
 
   bytes ret;
   evmc_status_code status = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
-  if (status == EVMC_SUCCESS && result.returnValue.size() > 0)
-    ret = move(result.returnValue);
+  if (status == EVMC_SUCCESS && !result.returnValue.empty())
+    ret = bytes{result.returnValue.view()};
 
   return {status, move(ret)};
 }
@@ -229,7 +498,7 @@ bytes evm2wasm(evmc::HostContext& context, bytes_view input) {
 
 // Calls the runevm contract.
 // @returns a wasm-based evm interpreter.
-bytes runevm(evmc::HostContext& context, bytes code) {
+bytes runevm(WasmEngine& engine, evmc::HostContext& context, bytes_view code) {
   HERA_DEBUG << "Calling runevm (code " << code.size() << " bytes)...\n";
 
   int64_t gas = numeric_limits<int64_t>::max(); // do not charge for metering yet (give unlimited gas)
@@ -237,6 +506,7 @@ bytes runevm(evmc::HostContext& context, bytes code) {
   bytes ret;
 
   tie(status, ret) = locallyExecuteSystemContract(
+      engine,
       context,
       runevmAddress,
       gas,
@@ -266,11 +536,6 @@ bytes runevm(evmc::HostContext& context, bytes code) {
   return ret;
 }
 
-void hera_destroy_result(evmc_result const* result) noexcept
-{
-  delete[] result->output_data;
-}
-
 evmc_result hera_execute(
   evmc_vm *vm,
   const evmc_host_interface* host_interface,
@@ -289,6 +554,12 @@ evmc_result hera_execute(
   memset(&ret, 0, sizeof(evmc_result));
 
   try {
+    // Frames called from this execution share its transaction cache.
+    TransactionScope transaction;
+
+    waitForPreparation(*hera);
+    WasmEngine& engine = hera->engine();
+
     heraAssert(rev == EVMC_BYZANTIUM, "Only Byzantium supported.");
     heraAssert(msg->gas >= 0, "EVMC supplied negative startgas");
 
@@ -297,8 +568,10 @@ evmc_result hera_execute(
     // the bytecode residing in the state - this will be used by interface methods (i.e. codecopy)
     bytes_view state_code{code, code_size};
 
-    // the actual executable code - this can be modified (metered or evm2wasm compiled)
-    bytes run_code{state_code};
+    // the actual executable code - this can be replaced (metered or evm2wasm compiled)
+    bytes_view run_code{state_code};
+    // owns the replacement code, if it was transformed
+    shared_ptr<bytes const> transformed_code;
 
     // replace executable code if replacement is supplied
     auto preload = hera->contract_preload_list.find(msg->recipient);
@@ -313,7 +586,10 @@ evmc_result hera_execute(
     if (!isWasm) {
       switch (hera->evm1mode) {
       case hera_evm1mode::evm2wasm_contract:
-        run_code = evm2wasm(host, run_code);
+        transformed_code = memoizedSystemContractCall(hera->evm2wasmCache, host, run_code, [&](bytes_view input) {
+          return evm2wasm(host, input);
+        });
+        run_code = *transformed_code;
         ensureCondition(run_code.size() > 8, ContractValidationFailure, "Transcompiling via evm2wasm failed");
         // TODO: enable this once evm2wasm does metering of interfaces
         // meterInterfaceGas = false;
@@ -327,7 +603,22 @@ evmc_result hera_execute(
         ret.status_code = EVMC_FAILURE;
         return ret;
       case hera_evm1mode::runevm_contract:
-        run_code = runevm(host, hera->contract_preload_list[runevmAddress]);
+        // The interpreter does not depend on the message, hence runevm is only executed once.
+        // Thereafter the engine finds the interpreter in its cache of loaded modules.
+        // Threads racing on the first use compute the same interpreter.
+        shared_ptr<bytes const> interpreter = atomic_load(&hera->runevmInterpreter);
+        if (!interpreter) {
+          auto runevmContract = hera->contract_preload_list.find(runevmAddress);
+          ensureCondition(
+            runevmContract != hera->contract_preload_list.end(),
+            ContractValidationFailure,
+            "Runevm contract is not loaded."
+          );
+          interpreter = make_shared<bytes const>(runevm(engine, host, runevmContract->second));
+          atomic_store(&hera->runevmInterpreter, interpreter);
+        }
+        transformed_code = move(interpreter);
+        run_code = *transformed_code;
         ensureCondition(run_code.size() > 8, ContractValidationFailure, "Interpreting via runevm failed");
         // Runevm does interface metering on its own
         meterInterfaceGas = false;
@@ -344,8 +635,12 @@ evmc_result hera_execute(
     // Avoid this in case of evm2wasm translated code
     if (msg->kind == EVMC_CREATE && isWasm) {
       // Meter the deployment (constructor) code if it is WebAssembly
-      if (hera->metering)
-        run_code = sentinel(host, run_code);
+      if (hera->metering) {
+        transformed_code = memoizedSystemContractCall(hera->sentinelCache, host, run_code, [&](bytes_view input) {
+          return sentinel(host, input);
+        });
+        run_code = *transformed_code;
+      }
       ensureCondition(
         hasWasmPreamble(run_code) && hasWasmVersion(run_code, 1),
         ContractValidationFailure,
@@ -353,42 +648,35 @@ evmc_result hera_execute(
       );
     }
 
-    heraAssert(hera->engine, "Wasm engine not set.");
-    WasmEngine& engine = *hera->engine;
-
-    ExecutionResult result = engine.execute(host, run_code, state_code, *msg, meterInterfaceGas);
+    ExecutionResult result = engine.execute(host, run_code, state_code, *msg, meterInterfaceGas, hera->storageWriteBack, hera->logBuffering);
     heraAssert(result.gasLeft >= 0, "Negative gas left after execution.");
 
-    // copy call result
-    if (result.returnValue.size() > 0) {
-      bytes returnValue;
-
-      if (msg->kind == EVMC_CREATE && !result.isRevert && hasWasmPreamble(result.returnValue)) {
+    // hand over the call result
+    if (!result.returnValue.empty()) {
+      if (msg->kind == EVMC_CREATE && !result.isRevert && hasWasmPreamble(result.returnValue.view())) {
         ensureCondition(
-          hasWasmVersion(result.returnValue, 1),
+          hasWasmVersion(result.returnValue.view(), 1),
           ContractValidationFailure,
           "Contract has an invalid WebAssembly version."
         );
 
         // Meter the deployed code if it is WebAssembly
-        returnValue = hera->metering ? sentinel(host, result.returnValue) : move(result.returnValue);
+        if (hera->metering) {
+          auto metered = memoizedSystemContractCall(hera->sentinelCache, host, result.returnValue.view(), [&](bytes_view input) {
+            return sentinel(host, input);
+          });
+          result.returnValue = OutputBuffer::copyOf(*metered);
+        }
         ensureCondition(
-          hasWasmPreamble(returnValue) && hasWasmVersion(returnValue, 1),
+          hasWasmPreamble(result.returnValue.view()) && hasWasmVersion(result.returnValue.view(), 1),
           ContractValidationFailure,
           "Invalid contract or metering failed."
         );
         // FIXME: this should be done by the sentinel
-        engine.verifyContract({returnValue.data(), returnValue.size()});
-      } else {
-        returnValue = move(result.returnValue);
+        engine.verifyContract(result.returnValue.view());
       }
 
-      uint8_t* output_data = new uint8_t[returnValue.size()];
-      copy(returnValue.begin(), returnValue.end(), output_data);
-
-      ret.output_size = returnValue.size();
-      ret.output_data = output_data;
-      ret.release = hera_destroy_result;
+      result.returnValue.releaseTo(ret);
     }
 
     ret.status_code = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
@@ -472,7 +760,19 @@ bool hera_parse_sys_option(hera_instance *hera, string const& _name, string cons
 
   HERA_DEBUG << "Loaded contract for " << name << " from " << value << " (" << contents.size() << " bytes)\n";
 
+  // EVM1 contracts are translated on execution.
+  if (hasWasmPreamble(contents)) {
+    if (hera->asyncPreparation) {
+      // Only the compilation is left to the background, invalid code is rejected here.
+      if (!verifySystemContract(hera->engine(), contents))
+        return false;
+      prepareSystemContractInBackground(*hera, contents);
+    } else if (!prepareSystemContract(hera->engine(), contents))
+      return false;
+  }
+
   hera->contract_preload_list[address] = move(contents);
+  resetSystemContractCaches(*hera);
 
   return true;
 }
@@ -508,16 +808,100 @@ evmc_set_option_result hera_set_option(
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+#if HERA_BINARYEN
+  if (strcmp(name, "memory-hugepages") == 0) {
+    if (strcmp(value, "true") == 0)
+      LinearMemory::setHugePages(true);
+    else if (strcmp(value, "false") == 0)
+      LinearMemory::setHugePages(false);
+    else
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+#endif
+
+#if HERA_WAVM
+  if (strcmp(name, "wavm-cache-entries") == 0) {
+    size_t maxEntries;
+    if (!parseDecimal(value, maxEntries))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    WavmEngine::setModuleCacheMaxEntries(maxEntries);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "wavm-cache-bytes") == 0) {
+    size_t maxBytes;
+    if (!parseDecimal(value, maxBytes))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    WavmEngine::setModuleCacheMaxBytes(maxBytes);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+#endif
+
+#if HERA_WAVM && (HERA_BINARYEN || HERA_WABT)
+  if (strcmp(name, "tiered-threshold") == 0) {
+    size_t threshold;
+    if (!parseDecimal(value, threshold))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    TieredEngine::setThreshold(threshold);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+#endif
+
+  if (strcmp(name, "cache-dir") == 0) {
+    if (*value != '\0' && !DiskCache::isValidDirectory(value))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->cacheDirectory = value;
+    resetSystemContractCaches(*hera);
+#if HERA_WAVM
+    WavmEngine::setModuleCacheDirectory(value);
+#endif
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strcmp(name, "engine") == 0) {
     auto it = wasm_engine_map.find(value);
     if (it != wasm_engine_map.end()) {
-      wasmEngineCreateFn = it->second;
-      hera->engine = wasmEngineCreateFn();
+      hera->createEngine = it->second;
+      hera->engineSelection = make_shared<EngineSelection const>();
+      prepareSystemContracts(*hera);
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+  if (strcmp(name, "storage-write-back") == 0) {
+    if (strcmp(value, "true") == 0)
+      hera->storageWriteBack = true;
+    else if (strcmp(value, "false") == 0)
+      hera->storageWriteBack = false;
+    else
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "log-buffering") == 0) {
+    if (strcmp(value, "true") == 0)
+      hera->logBuffering = true;
+    else if (strcmp(value, "false") == 0)
+      hera->logBuffering = false;
+    else
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "async-preload") == 0) {
+    if (strcmp(value, "true") == 0)
+      hera->asyncPreparation = true;
+    else if (strcmp(value, "false") == 0)
+      hera->asyncPreparation = false;
+    else
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strncmp(name, "sys:", 4) == 0) {
     if (hera_parse_sys_option(hera, string(name), string(value)))
       return EVMC_SET_OPTION_SUCCESS;
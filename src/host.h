@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include <evmc/evmc.hpp>
+
+namespace hera {
+
+/// The answers of the host that are fixed during a transaction: the transaction
+/// context and block hashes. Shared by the frames of an execution.
+class TransactionCache {
+public:
+  evmc_tx_context const& get_tx_context(evmc::HostContext& host)
+  {
+    if (!m_txContextLoaded) {
+      m_txContext = host.get_tx_context();
+      m_txContextLoaded = true;
+    }
+    return m_txContext;
+  }
+
+  evmc::bytes32 get_block_hash(evmc::HostContext& host, int64_t number)
+  {
+    auto it = m_blockHashes.find(number);
+    if (it == m_blockHashes.end())
+      it = m_blockHashes.emplace(number, host.get_block_hash(number)).first;
+    return it->second;
+  }
+
+private:
+  bool m_txContextLoaded = false;
+  evmc_tx_context m_txContext{};
+  std::unordered_map<int64_t, evmc::bytes32> m_blockHashes;
+};
+
+/// The transaction cache of the outermost execution on this thread, if any.
+/// Nested frames run on the thread of their caller, as the host calls back into Hera.
+inline thread_local TransactionCache* currentTransaction = nullptr;
+
+/// Provides the transaction cache for the executions on this thread while alive,
+/// unless an enclosing execution already did.
+class TransactionScope {
+public:
+  TransactionScope() noexcept: m_outermost(currentTransaction == nullptr)
+  {
+    if (m_outermost)
+      currentTransaction = &m_cache;
+  }
+
+  ~TransactionScope() noexcept
+  {
+    if (m_outermost)
+      currentTransaction = nullptr;
+  }
+
+  TransactionScope(TransactionScope const&) = delete;
+  TransactionScope& operator=(TransactionScope const&) = delete;
+
+private:
+  bool m_outermost;
+  TransactionCache m_cache;
+};
+
+/// The host of an execution, answering repeated queries from a cache.
+///
+/// The transaction context and block hashes are fixed during a transaction, hence
+/// they are shared with the other frames through the current TransactionScope.
+/// Balances, the existence of accounts and code sizes may only change while
+/// the execution calls out, hence they are dropped after calls, creates and
+/// selfdestruct. Other requests are passed through.
+class CachingHost {
+public:
+  explicit CachingHost(evmc::HostContext& host) noexcept:
+    m_host(host),
+    m_transaction(currentTransaction ? *currentTransaction : m_ownTransaction)
+  {}
+
+  // The transaction cache may refer to a member.
+  CachingHost(CachingHost const&) = delete;
+  CachingHost& operator=(CachingHost const&) = delete;
+
+  evmc_tx_context const& get_tx_context() { return m_transaction.get_tx_context(m_host); }
+
+  evmc::bytes32 get_block_hash(int64_t number) { return m_transaction.get_block_hash(m_host, number); }
+
+  evmc::uint256be get_balance(evmc::address const& address)
+  {
+    auto it = m_balances.find(address);
+    if (it == m_balances.end())
+      it = m_balances.emplace(address, m_host.get_balance(address)).first;
+    return it->second;
+  }
+
+  bool account_exists(evmc::address const& address)
+  {
+    auto it = m_accountExists.find(address);
+    if (it == m_accountExists.end())
+      it = m_accountExists.emplace(address, m_host.account_exists(address)).first;
+    return it->second;
+  }
+
+  size_t get_code_size(evmc::address const& address)
+  {
+    auto it = m_codeSizes.find(address);
+    if (it == m_codeSizes.end())
+      it = m_codeSizes.emplace(address, m_host.get_code_size(address)).first;
+    return it->second;
+  }
+
+  size_t copy_code(evmc::address const& address, size_t codeOffset, uint8_t* bufferData, size_t bufferSize) noexcept
+  {
+    return m_host.copy_code(address, codeOffset, bufferData, bufferSize);
+  }
+
+  evmc::bytes32 get_storage(evmc::address const& address, evmc::bytes32 const& key) noexcept
+  {
+    return m_host.get_storage(address, key);
+  }
+
+  evmc_storage_status set_storage(evmc::address const& address, evmc::bytes32 const& key, evmc::bytes32 const& value) noexcept
+  {
+    return m_host.set_storage(address, key, value);
+  }
+
+  void emit_log(evmc::address const& address, uint8_t const* data, size_t dataSize, evmc::bytes32 const topics[], size_t numTopics) noexcept
+  {
+    m_host.emit_log(address, data, dataSize, topics, numTopics);
+  }
+
+  evmc::Result call(evmc_message const& message) noexcept
+  {
+    evmc::Result result = m_host.call(message);
+    dropAccounts();
+    return result;
+  }
+
+  bool selfdestruct(evmc::address const& address, evmc::address const& beneficiary) noexcept
+  {
+    bool const ret = m_host.selfdestruct(address, beneficiary);
+    dropAccounts();
+    return ret;
+  }
+
+private:
+  void dropAccounts() noexcept
+  {
+    m_balances.clear();
+    m_accountExists.clear();
+    m_codeSizes.clear();
+  }
+
+  evmc::HostContext& m_host;
+  // Used when no execution provides a transaction cache.
+  TransactionCache m_ownTransaction;
+  TransactionCache& m_transaction;
+  std::unordered_map<evmc::address, evmc::uint256be> m_balances;
+  std::unordered_map<evmc::address, bool> m_accountExists;
+  std::unordered_map<evmc::address, size_t> m_codeSizes;
+};
+
+}
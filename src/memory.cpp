@@ -0,0 +1,199 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// Memories are reserved at this size at least. Only the touched pages are backed.
+constexpr size_t minReservation = 16 * 1024 * 1024;
+// Enough for every level of nested calls.
+constexpr size_t maxPooledMemories = 1024;
+
+atomic<bool> hugePages{false};
+
+size_t pageSize() noexcept
+{
+  static size_t const size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+size_t roundUpToPages(size_t size) noexcept
+{
+  size_t const mask = pageSize() - 1;
+  return (size + mask) & ~mask;
+}
+
+uint8_t* reserve(size_t capacity)
+{
+  void* base = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED)
+    throw bad_alloc{};
+#ifdef MADV_HUGEPAGE
+  if (hugePages)
+    ::madvise(base, capacity, MADV_HUGEPAGE);
+#endif
+  return static_cast<uint8_t*>(base);
+}
+
+// Zeroes the bytes between @from and @to. Whole pages are given back to the
+// system instead, which maps them to zero pages on their next access.
+void discard(uint8_t* base, size_t from, size_t to) noexcept
+{
+#ifdef __linux__
+  size_t const firstPage = roundUpToPages(from);
+  size_t const lastPage = to & ~(pageSize() - 1);
+  if (firstPage < lastPage && ::madvise(base + firstPage, lastPage - firstPage, MADV_DONTNEED) == 0) {
+    memset(base + from, 0, firstPage - from);
+    memset(base + lastPage, 0, to - lastPage);
+    return;
+  }
+#endif
+  memset(base + from, 0, to - from);
+}
+
+struct Reservation {
+  uint8_t* base;
+  size_t capacity;
+};
+
+class MemoryPool {
+public:
+  MemoryPool()
+  {
+    // Reserved upfront, hence returning a memory never allocates.
+    m_free.reserve(maxPooledMemories);
+  }
+
+  // Returns a zeroed reservation able to hold @size bytes.
+  Reservation acquire(size_t size)
+  {
+    {
+      lock_guard<mutex> lock{m_mutex};
+      auto it = find_if(m_free.rbegin(), m_free.rend(), [&](Reservation const& r) { return r.capacity >= size; });
+      if (it != m_free.rend()) {
+        Reservation reservation = *it;
+        m_free.erase(next(it).base());
+        return reservation;
+      }
+    }
+    size_t const capacity = max(minReservation, roundUpToPages(size));
+    return {reserve(capacity), capacity};
+  }
+
+  // Takes back a reservation with its first @used bytes possibly dirty.
+  void release(Reservation reservation, size_t used) noexcept
+  {
+    discard(reservation.base, 0, used);
+    {
+      lock_guard<mutex> lock{m_mutex};
+      if (m_free.size() < maxPooledMemories) {
+        m_free.push_back(reservation);
+        return;
+      }
+    }
+    ::munmap(reservation.base, reservation.capacity);
+  }
+
+private:
+  mutex m_mutex;
+  vector<Reservation> m_free;
+};
+
+// Never destroyed, as memories may be released during static destruction.
+MemoryPool& memoryPool()
+{
+  static MemoryPool* pool = new MemoryPool;
+  return *pool;
+}
+
+}
+
+LinearMemory::LinearMemory(LinearMemory&& other) noexcept:
+  m_base(exchange(other.m_base, nullptr)),
+  m_capacity(exchange(other.m_capacity, 0)),
+  m_size(exchange(other.m_size, 0))
+{}
+
+LinearMemory& LinearMemory::operator=(LinearMemory&& other) noexcept
+{
+  if (this != &other) {
+    release();
+    m_base = exchange(other.m_base, nullptr);
+    m_capacity = exchange(other.m_capacity, 0);
+    m_size = exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+LinearMemory::~LinearMemory() noexcept
+{
+  release();
+}
+
+void LinearMemory::release() noexcept
+{
+  if (m_base)
+    memoryPool().release({m_base, m_capacity}, m_size);
+  m_base = nullptr;
+  m_capacity = 0;
+  m_size = 0;
+}
+
+void LinearMemory::resize(size_t newSize)
+{
+  if (!m_base) {
+    Reservation reservation = memoryPool().acquire(newSize);
+    m_base = reservation.base;
+    m_capacity = reservation.capacity;
+  }
+
+  if (newSize > m_capacity) {
+    // Move to a larger reservation. This is rare, as only the touched pages count.
+    size_t const capacity = max(2 * m_capacity, roundUpToPages(newSize));
+    uint8_t* base = reserve(capacity);
+    memcpy(base, m_base, m_size);
+    memoryPool().release({m_base, m_capacity}, m_size);
+    m_base = base;
+    m_capacity = capacity;
+  } else if (newSize < m_size) {
+    discard(m_base, newSize, m_size);
+  }
+
+  m_size = newSize;
+}
+
+void LinearMemory::setHugePages(bool enabled) noexcept
+{
+  hugePages = enabled;
+}
+
+}
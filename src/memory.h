@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hera {
+
+/// The linear memory of a WebAssembly instance, backed by pages reserved with mmap.
+///
+/// Released memories are kept in a process-wide pool and handed out to later
+/// instances, hence nested calls and subsequent executions do not allocate
+/// memory. Their used pages are returned to the system on release, so that
+/// reused memory reads as zero without being cleared.
+class LinearMemory {
+public:
+  LinearMemory() noexcept = default;
+  LinearMemory(LinearMemory&& other) noexcept;
+  LinearMemory& operator=(LinearMemory&& other) noexcept;
+  ~LinearMemory() noexcept;
+
+  LinearMemory(LinearMemory const&) = delete;
+  LinearMemory& operator=(LinearMemory const&) = delete;
+
+  uint8_t* data() noexcept { return m_base; }
+  size_t size() const noexcept { return m_size; }
+
+  /// Resizes the memory to @newSize bytes, where new bytes read as zero.
+  /// The memory may move when growing.
+  void resize(size_t newSize);
+
+  /// Requests transparent huge pages for memories reserved hereafter, where supported.
+  static void setHugePages(bool enabled) noexcept;
+
+private:
+  void release() noexcept;
+
+  uint8_t* m_base = nullptr;
+  size_t m_capacity = 0;
+  size_t m_size = 0;
+};
+
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "output.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// Buffers are allocated in power-of-two size classes, from 64 bytes to 1 MiB.
+// Larger buffers are rare and are not pooled.
+constexpr unsigned minSizeClassShift = 6;
+constexpr unsigned maxSizeClassShift = 20;
+constexpr size_t maxPooledPerSizeClass = 16;
+
+// The capacity of a buffer is stored in front of its data, as the release
+// callback of evmc_result only receives the data pointer.
+constexpr size_t headerSize = alignof(max_align_t);
+static_assert(headerSize >= sizeof(size_t), "Buffer header is too small");
+
+uint8_t* allocateBlock(size_t capacity)
+{
+  auto block = static_cast<uint8_t*>(::operator new(headerSize + capacity));
+  memcpy(block, &capacity, sizeof(capacity));
+  return block + headerSize;
+}
+
+size_t blockCapacity(uint8_t const* data) noexcept
+{
+  size_t capacity;
+  memcpy(&capacity, data - headerSize, sizeof(capacity));
+  return capacity;
+}
+
+void freeBlock(uint8_t* data) noexcept
+{
+  ::operator delete(data - headerSize);
+}
+
+class BufferPool {
+public:
+  BufferPool()
+  {
+    // Reserved upfront, hence returning a buffer never allocates.
+    for (auto& buffers: m_free)
+      buffers.reserve(maxPooledPerSizeClass);
+  }
+
+  uint8_t* acquire(size_t size)
+  {
+    unsigned shift = minSizeClassShift;
+    while (shift <= maxSizeClassShift && (size_t(1) << shift) < size)
+      ++shift;
+    if (shift > maxSizeClassShift)
+      return allocateBlock(size);
+
+    {
+      lock_guard<mutex> lock{m_mutex};
+      auto& buffers = m_free[shift - minSizeClassShift];
+      if (!buffers.empty()) {
+        uint8_t* data = buffers.back();
+        buffers.pop_back();
+        return data;
+      }
+    }
+    return allocateBlock(size_t(1) << shift);
+  }
+
+  void release(uint8_t* data) noexcept
+  {
+    size_t const capacity = blockCapacity(data);
+    for (unsigned shift = minSizeClassShift; shift <= maxSizeClassShift; ++shift) {
+      if ((size_t(1) << shift) != capacity)
+        continue;
+      lock_guard<mutex> lock{m_mutex};
+      auto& buffers = m_free[shift - minSizeClassShift];
+      if (buffers.size() < maxPooledPerSizeClass) {
+        buffers.push_back(data);
+        return;
+      }
+      break;
+    }
+    freeBlock(data);
+  }
+
+private:
+  mutex m_mutex;
+  array<vector<uint8_t*>, maxSizeClassShift - minSizeClassShift + 1> m_free;
+};
+
+// Never destroyed, as clients may release results after static destruction began.
+BufferPool& bufferPool()
+{
+  static BufferPool* pool = new BufferPool;
+  return *pool;
+}
+
+void releaseResultOutput(evmc_result const* result) noexcept
+{
+  if (result->output_data)
+    bufferPool().release(const_cast<uint8_t*>(result->output_data));
+}
+
+}
+
+OutputBuffer::OutputBuffer(size_t size):
+  m_data(size ? bufferPool().acquire(size) : nullptr),
+  m_size(size)
+{}
+
+OutputBuffer::OutputBuffer(OutputBuffer&& other) noexcept:
+  m_data(exchange(other.m_data, nullptr)),
+  m_size(exchange(other.m_size, 0))
+{}
+
+OutputBuffer& OutputBuffer::operator=(OutputBuffer&& other) noexcept
+{
+  if (this != &other) {
+    if (m_data)
+      bufferPool().release(m_data);
+    m_data = exchange(other.m_data, nullptr);
+    m_size = exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+OutputBuffer::~OutputBuffer() noexcept
+{
+  if (m_data)
+    bufferPool().release(m_data);
+}
+
+OutputBuffer OutputBuffer::copyOf(bytes_view data)
+{
+  OutputBuffer buffer{data.size()};
+  if (!data.empty())
+    memcpy(buffer.data(), data.data(), data.size());
+  return buffer;
+}
+
+void OutputBuffer::releaseTo(evmc_result& result) noexcept
+{
+  result.output_data = exchange(m_data, nullptr);
+  result.output_size = exchange(m_size, 0);
+  result.release = releaseResultOutput;
+}
+
+}
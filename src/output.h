@@ -0,0 +1,60 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <evmc/evmc.h>
+
+#include "helpers.h"
+
+namespace hera {
+
+/// The output of an execution, handed over to the client without copying.
+///
+/// Buffers are drawn from a process-wide pool, to which they return when
+/// destroyed or when the client releases the evmc_result holding them.
+class OutputBuffer {
+public:
+  OutputBuffer() noexcept = default;
+  /// Acquires an uninitialised buffer of @size bytes.
+  explicit OutputBuffer(size_t size);
+  OutputBuffer(OutputBuffer&& other) noexcept;
+  OutputBuffer& operator=(OutputBuffer&& other) noexcept;
+  ~OutputBuffer() noexcept;
+
+  OutputBuffer(OutputBuffer const&) = delete;
+  OutputBuffer& operator=(OutputBuffer const&) = delete;
+
+  /// @returns a buffer holding a copy of @data.
+  static OutputBuffer copyOf(bytes_view data);
+
+  uint8_t* data() noexcept { return m_data; }
+  size_t size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  bytes_view view() const noexcept { return {m_data, m_size}; }
+
+  /// Hands the buffer over to @result, whose release callback returns it to the pool.
+  void releaseTo(evmc_result& result) noexcept;
+
+private:
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+}
@@ -21,11 +21,14 @@
 #ifndef wasm_shell_interface_h
 #define wasm_shell_interface_h
 
+#include <cstring>
 #include <vector>
 
 #include <wasm.h>
 #include <wasm-interpreter.h>
 
+#include "memory.h"
+
 namespace wasm {
 
 struct ExitException {};
@@ -37,11 +40,10 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
   // properly. Avoid emitting unaligned load/store by checking for alignment
   // explicitly, and performing memcpy if unaligned.
   //
-  // The allocated memory tries to have the same alignment as the memory being
-  // simulated.
+  // The memory is page-aligned, hence it has the same alignment as the memory
+  // being simulated. It is drawn from Hera's pool of linear memories.
   class Memory {
-    // Use char because it doesn't run afoul of aliasing rules.
-    std::vector<char> memory;
+    hera::LinearMemory memory;
     template <typename T>
     static bool aligned(const char* address) {
       static_assert(!(sizeof(T) & (sizeof(T) - 1)), "must be a power of 2");
@@ -54,38 +56,30 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
     Memory() {}
     // Gives no guarantee about the length of the memory. Caller needs to ensure that.
     char* rawpointer(size_t offset) {
-      return &memory[offset];
+      // Use char because it doesn't run afoul of aliasing rules.
+      return reinterpret_cast<char*>(memory.data()) + offset;
     }
     size_t size() const { return memory.size(); }
     void resize(size_t newSize) {
-      // Ensure the smallest allocation is large enough that most allocators
-      // will provide page-aligned storage. This hopefully allows the
-      // interpreter's memory to be as aligned as the memory being simulated,
-      // ensuring that the performance doesn't needlessly degrade.
-      //
-      // The code is optimistic this will work until WG21's p0035r0 happens.
-      const size_t minSize = 1 << 12;
-      size_t oldSize = memory.size();
-      memory.resize(std::max(minSize, newSize));
-      if (newSize < oldSize && newSize < minSize) {
-        std::memset(&memory[newSize], 0, minSize - newSize);
-      }
+      memory.resize(newSize);
     }
     template <typename T>
     void set(size_t address, T value) {
-      if (aligned<T>(&memory[address])) {
-        *reinterpret_cast<T*>(&memory[address]) = value;
+      char* pointer = rawpointer(address);
+      if (aligned<T>(pointer)) {
+        *reinterpret_cast<T*>(pointer) = value;
       } else {
-        std::memcpy(&memory[address], &value, sizeof(T));
+        std::memcpy(pointer, &value, sizeof(T));
       }
     }
     template <typename T>
     T get(size_t address) {
-      if (aligned<T>(&memory[address])) {
-        return *reinterpret_cast<T*>(&memory[address]);
+      char* pointer = rawpointer(address);
+      if (aligned<T>(pointer)) {
+        return *reinterpret_cast<T*>(pointer);
       } else {
         T loaded;
-        std::memcpy(&loaded, &memory[address], sizeof(T));
+        std::memcpy(&loaded, pointer, sizeof(T));
         return loaded;
       }
     }
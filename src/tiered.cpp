@@ -0,0 +1,238 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "tiered.h"
+
+#include "cache.h"
+#include "debugging.h"
+#if HERA_BINARYEN
+#include "binaryen.h"
+#endif
+#if HERA_WABT
+#include "wabt.h"
+#endif
+#include "wavm.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+enum class Tier {
+  interpreted,
+  compiling,
+  compiled,
+  // Rejected by WAVM, stays with the interpreter.
+  failed,
+};
+
+struct TierState {
+  atomic<uint64_t> executions{0};
+  // Moves from interpreted to compiling once, when the contract is queued for compilation.
+  atomic<Tier> tier{Tier::interpreted};
+  // Owned here rather than left to the module cache, which may evict it. Accessed atomically.
+  shared_ptr<WavmModule> compiled;
+};
+
+CodeCache<TierState> tierStates{4096, 64 * 1024 * 1024};
+
+atomic<uint64_t> threshold{10};
+
+struct {
+  atomic<uint64_t> interpretedExecutions{0};
+  atomic<uint64_t> compiledExecutions{0};
+  atomic<uint64_t> compilationsStarted{0};
+  atomic<uint64_t> compilationsFinished{0};
+  atomic<uint64_t> compilationsFailed{0};
+} counters;
+
+void logStatistics()
+{
+  TieringStatistics const stats = TieredEngine::statistics();
+  HERA_DEBUG << "Tiering: " << stats.interpretedExecutions << " interpreted, "
+             << stats.compiledExecutions << " compiled executions; "
+             << stats.compilationsStarted << " compilations started, "
+             << stats.compilationsFinished << " finished, "
+             << stats.compilationsFailed << " failed\n";
+}
+
+// A single background thread compiling hot contracts in order.
+// WAVM compilations are serialised process-wide anyway.
+class CompilationQueue {
+public:
+  ~CompilationQueue()
+  {
+    {
+      lock_guard<mutex> lock{m_mutex};
+      m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    if (m_worker.joinable())
+      m_worker.join();
+  }
+
+  void push(bytes code, shared_ptr<TierState> state)
+  {
+    {
+      lock_guard<mutex> lock{m_mutex};
+      m_jobs.emplace_back(move(code), move(state));
+      if (!m_worker.joinable())
+        m_worker = thread{&CompilationQueue::run, this};
+    }
+    m_wakeup.notify_one();
+  }
+
+private:
+  void run()
+  {
+    WavmEngine compiler;
+    unique_lock<mutex> lock{m_mutex};
+    while (true) {
+      m_wakeup.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+      if (m_stopping)
+        return;
+
+      auto job = move(m_jobs.front());
+      m_jobs.pop_front();
+      lock.unlock();
+      compile(compiler, job.first, *job.second);
+      lock.lock();
+    }
+  }
+
+  static void compile(WavmEngine& compiler, bytes_view code, TierState& state) noexcept
+  {
+    try {
+      atomic_store(&state.compiled, compiler.compileContract(code));
+      state.tier = Tier::compiled;
+      counters.compilationsFinished++;
+      HERA_DEBUG << "Tiered up contract (" << code.size() << " bytes)\n";
+    } catch (exception const& e) {
+      state.tier = Tier::failed;
+      counters.compilationsFailed++;
+      HERA_DEBUG << "Failed to tier up contract: " << e.what() << "\n";
+    } catch (...) {
+      state.tier = Tier::failed;
+      counters.compilationsFailed++;
+      HERA_DEBUG << "Failed to tier up contract\n";
+    }
+    logStatistics();
+  }
+
+  mutex m_mutex;
+  condition_variable m_wakeup;
+  deque<pair<bytes, shared_ptr<TierState>>> m_jobs;
+  bool m_stopping = false;
+  thread m_worker;
+};
+
+// Created on first use, hence destroyed (and joined) before the WAVM runtime.
+CompilationQueue& compilationQueue()
+{
+  static CompilationQueue queue;
+  return queue;
+}
+
+unique_ptr<WasmEngine> createInterpreter()
+{
+#if HERA_BINARYEN
+  return BinaryenEngine::create();
+#else
+  return WabtEngine::create();
+#endif
+}
+
+}
+
+TieredEngine::TieredEngine():
+  m_interpreter(createInterpreter()),
+  m_compiler(new WavmEngine)
+{}
+
+unique_ptr<WasmEngine> TieredEngine::create()
+{
+  return unique_ptr<WasmEngine>{new TieredEngine};
+}
+
+void TieredEngine::setThreshold(uint64_t value) noexcept
+{
+  threshold = value;
+}
+
+TieringStatistics TieredEngine::statistics() noexcept
+{
+  TieringStatistics ret;
+  ret.interpretedExecutions = counters.interpretedExecutions.load();
+  ret.compiledExecutions = counters.compiledExecutions.load();
+  ret.compilationsStarted = counters.compilationsStarted.load();
+  ret.compilationsFinished = counters.compilationsFinished.load();
+  ret.compilationsFailed = counters.compilationsFailed.load();
+  return ret;
+}
+
+ExecutionResult TieredEngine::execute(
+  evmc::HostContext& context,
+  bytes_view code,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
+) {
+  shared_ptr<TierState> state = tierStates.find(code);
+  if (!state)
+    state = tierStates.insert(code, make_shared<TierState>(), code.size());
+
+  if (state->tier == Tier::compiled) {
+    shared_ptr<WavmModule> compiled = atomic_load(&state->compiled);
+    counters.compiledExecutions++;
+    return m_compiler->executeModule(*compiled, context, state_code, msg, meterInterfaceGas, storageWriteBack, logBuffering);
+  }
+
+  // Contracts reaching the threshold are queued once, also when it was lowered since.
+  uint64_t const executions = ++state->executions;
+  uint64_t const limit = threshold;
+  if (limit != 0 && executions >= limit && state->tier == Tier::interpreted) {
+    Tier expected = Tier::interpreted;
+    if (state->tier.compare_exchange_strong(expected, Tier::compiling)) {
+      counters.compilationsStarted++;
+      compilationQueue().push(bytes{code}, state);
+    }
+  }
+
+  counters.interpretedExecutions++;
+  return m_interpreter->execute(context, code, state_code, msg, meterInterfaceGas, storageWriteBack, logBuffering);
+}
+
+void TieredEngine::verifyContract(bytes_view code)
+{
+  m_interpreter->verifyContract(code);
+}
+
+void TieredEngine::prepareContract(bytes_view code)
+{
+  m_interpreter->prepareContract(code);
+}
+
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "eei.h"
+#include "wavm.h"
+
+namespace hera {
+
+/// Counters of the tiered engine, accumulated over the process.
+struct TieringStatistics {
+  uint64_t interpretedExecutions = 0;
+  uint64_t compiledExecutions = 0;
+  uint64_t compilationsStarted = 0;
+  uint64_t compilationsFinished = 0;
+  uint64_t compilationsFailed = 0;
+};
+
+/// Executes contracts with an interpreter until they are found to be hot,
+/// then compiles them with WAVM on a background thread and switches to
+/// the compiled code once it is ready.
+///
+/// Hotness is tracked per contract code, process-wide.
+class TieredEngine : public WasmEngine {
+public:
+  /// Factory method to create the tiered Wasm Engine.
+  static std::unique_ptr<WasmEngine> create();
+
+  ExecutionResult execute(
+    evmc::HostContext& context,
+    bytes_view code,
+    bytes_view state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
+  ) override;
+
+  void verifyContract(bytes_view code) override;
+
+  void prepareContract(bytes_view code) override;
+
+  /// Sets the number of interpreted executions after which a contract is compiled.
+  /// Zero disables compilation.
+  static void setThreshold(uint64_t threshold) noexcept;
+
+  /// Returns the tier transitions and executions so far.
+  static TieringStatistics statistics() noexcept;
+
+private:
+  TieredEngine();
+
+  std::unique_ptr<WasmEngine> m_interpreter;
+  std::unique_ptr<WavmEngine> m_compiler;
+};
+
+}
@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "src/interp/binary-reader-interp.h"
 #include "src/binary-reader.h"
@@ -30,8 +33,9 @@
 #include "src/wast-parser.h"
 
 #include "wabt.h"
+#include "cache.h"
 #include "debugging.h"
-#include "eei.h"
+#include "eei-impl.h"
 #include "exceptions.h"
 
 using namespace std;
@@ -39,16 +43,18 @@ using namespace wabt;
 
 namespace hera {
 
-class WabtEthereumInterface : public EthereumInterface {
+class WabtEthereumInterface : public EthereumInterface<WabtEthereumInterface> {
 public:
   explicit WabtEthereumInterface(
     evmc::HostContext& _context,
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _writeBack,
+    bool _bufferLogs
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _writeBack, _bufferLogs)
   {}
 
   // TODO: improve this design...
@@ -57,11 +63,11 @@ public:
   }
 
 private:
+  friend class EthereumInterface<WabtEthereumInterface>;
+
   // These assume that m_wasmMemory was set prior to execution.
-  size_t memorySize() const override { return m_wasmMemory->data.size(); }
-  void memorySet(size_t offset, uint8_t value) override { m_wasmMemory->data[offset] = static_cast<char>(value); }
-  uint8_t memoryGet(size_t offset) override { return static_cast<uint8_t>(m_wasmMemory->data[offset]); }
-  uint8_t* memoryPointer(size_t offset, size_t length) override {
+  size_t memorySize() const { return m_wasmMemory->data.size(); }
+  uint8_t* memoryPointer(size_t offset, size_t length) {
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
     return reinterpret_cast<uint8_t*>(&m_wasmMemory->data[offset]);
   }
@@ -69,29 +75,12 @@ private:
   interp::Memory* m_wasmMemory;
 };
 
-unique_ptr<WasmEngine> WabtEngine::create()
-{
-  return unique_ptr<WasmEngine>{new WabtEngine};
-}
-
-ExecutionResult WabtEngine::execute(
-  evmc::HostContext& context,
-  bytes_view code,
-  bytes_view state_code,
-  evmc_message const& msg,
-  bool meterInterfaceGas
-) {
-  instantiationStarted();
-  HERA_DEBUG << "Executing with wabt...\n";
-
-  // Set up the wabt Environment, which includes the Wasm store
-  // and the list of modules used for importing/exporting between modules
-  interp::Environment env;
-
-  // Set up interface to eei host functions
-  ExecutionResult result;
-  WabtEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
+namespace {
 
+// Adds the EEI (and debugging) host modules to the environment.
+// The host functions forward to the interface @interface points to at the time of the call.
+void appendHostModules(interp::Environment& env, WabtEthereumInterface* const& interface)
+{
   // Create EEI host module
   // The lifecycle of this pointer is handled by `env`.
   interp::HostModule* hostModule = env.AppendHostModule("ethereum");
@@ -106,7 +95,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiUseGas(static_cast<int64_t>(args[0].value.i64));
+      interface->eeiUseGas(static_cast<int64_t>(args[0].value.i64));
       return interp::Result::Ok;
     }
   );
@@ -120,7 +109,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetAddress(args[0].value.i32);
+      interface->eeiGetAddress(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -134,7 +123,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetExternalBalance(args[0].value.i32, args[1].value.i32);
+      interface->eeiGetExternalBalance(args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -148,7 +137,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetBlockHash(args[0].value.i64, args[1].value.i32));
+      results[0].set_i32(interface->eeiGetBlockHash(args[0].value.i64, args[1].value.i32));
       return interp::Result::Ok;
     }
   );
@@ -162,8 +151,8 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::Call,
+      results[0].set_i32(interface->eeiCall(
+        WabtEthereumInterface::EEICallKind::Call,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
         args[2].value.i32, args[3].value.i32, args[4].value.i32
       ));
@@ -180,7 +169,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiCallDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiCallDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -194,7 +183,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetCallDataSize());
+      results[0].set_i32(interface->eeiGetCallDataSize());
       return interp::Result::Ok;
     }
   );
@@ -208,8 +197,8 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallCode,
+      results[0].set_i32(interface->eeiCall(
+        WabtEthereumInterface::EEICallKind::CallCode,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
         args[2].value.i32, args[3].value.i32, args[4].value.i32
       ));
@@ -226,8 +215,8 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallDelegate,
+      results[0].set_i32(interface->eeiCall(
+        WabtEthereumInterface::EEICallKind::CallDelegate,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
         args[2].value.i32, args[3].value.i32
       ));
@@ -244,8 +233,8 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
-        EthereumInterface::EEICallKind::CallStatic,
+      results[0].set_i32(interface->eeiCall(
+        WabtEthereumInterface::EEICallKind::CallStatic,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
         args[2].value.i32, args[3].value.i32
       ));
@@ -262,7 +251,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiStorageStore(args[0].value.i32, args[1].value.i32);
+      interface->eeiStorageStore(args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -276,7 +265,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiStorageLoad(args[0].value.i32, args[1].value.i32);
+      interface->eeiStorageLoad(args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -290,7 +279,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetCaller(args[0].value.i32);
+      interface->eeiGetCaller(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -304,7 +293,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetCallValue(args[0].value.i32);
+      interface->eeiGetCallValue(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -318,7 +307,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiCodeCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiCodeCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -332,7 +321,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetCodeSize());
+      results[0].set_i32(interface->eeiGetCodeSize());
       return interp::Result::Ok;
     }
   );
@@ -346,7 +335,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetBlockCoinbase(args[0].value.i32);
+      interface->eeiGetBlockCoinbase(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -360,7 +349,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCreate(
+      results[0].set_i32(interface->eeiCreate(
         args[0].value.i32, args[1].value.i32,
         args[2].value.i32, args[3].value.i32
       ));
@@ -377,7 +366,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetBlockDifficulty(args[0].value.i32);
+      interface->eeiGetBlockDifficulty(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -391,7 +380,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiExternalCodeCopy(
+      interface->eeiExternalCodeCopy(
         args[0].value.i32, args[1].value.i32,
         args[2].value.i32, args[3].value.i32
       );
@@ -408,7 +397,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetExternalCodeSize(args[0].value.i32));
+      results[0].set_i32(interface->eeiGetExternalCodeSize(args[0].value.i32));
       return interp::Result::Ok;
     }
   );
@@ -422,7 +411,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetGasLeft()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetGasLeft()));
       return interp::Result::Ok;
     }
   );
@@ -436,7 +425,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockGasLimit()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockGasLimit()));
       return interp::Result::Ok;
     }
   );
@@ -450,7 +439,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetTxGasPrice(args[0].value.i32);
+      interface->eeiGetTxGasPrice(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -464,7 +453,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiLog(
+      interface->eeiLog(
         args[0].value.i32, args[1].value.i32, args[2].value.i32, args[3].value.i32,
         args[4].value.i32, args[5].value.i32, args[6].value.i32
       );
@@ -481,7 +470,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockNumber()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockNumber()));
       return interp::Result::Ok;
     }
   );
@@ -495,7 +484,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetTxOrigin(args[0].value.i32);
+      interface->eeiGetTxOrigin(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -509,7 +498,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiFinish(args[0].value.i32, args[1].value.i32);
+      interface->eeiFinish(args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -523,7 +512,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiRevert(args[0].value.i32, args[1].value.i32);
+      interface->eeiRevert(args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -537,7 +526,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetReturnDataSize());
+      results[0].set_i32(interface->eeiGetReturnDataSize());
       return interp::Result::Ok;
     }
   );
@@ -551,7 +540,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiReturnDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiReturnDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -565,7 +554,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiSelfDestruct(args[0].value.i32);
+      interface->eeiSelfDestruct(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -579,7 +568,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockTimestamp()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockTimestamp()));
       return interp::Result::Ok;
     }
   );
@@ -599,7 +588,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrint32(args[0].value.i32);
+      interface->debugPrint32(args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -613,7 +602,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrint64(args[0].value.i64);
+      interface->debugPrint64(args[0].value.i64);
       return interp::Result::Ok;
     }
   );
@@ -627,7 +616,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintMem(false, args[0].value.i32, args[1].value.i32);
+      interface->debugPrintMem(false, args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -641,7 +630,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintMem(true, args[0].value.i32, args[1].value.i32);
+      interface->debugPrintMem(true, args[0].value.i32, args[1].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -655,7 +644,7 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintStorage(false, args[0].value.i32);
+      interface->debugPrintStorage(false, args[0].value.i32);
       return interp::Result::Ok;
     }
   );
@@ -669,12 +658,115 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintStorage(true, args[0].value.i32);
+      interface->debugPrintStorage(true, args[0].value.i32);
       return interp::Result::Ok;
     }
   );
 #endif
 
+}
+
+// A contract loaded into an environment of its own together with the host modules.
+// It is reused across executions by restoring the state it had after instantiation.
+struct WabtInstance {
+  interp::Environment env;
+  // The interface of the running execution.
+  WabtEthereumInterface* interface = nullptr;
+  interp::Export* mainFunction = nullptr;
+
+  // State after instantiation.
+  vector<Limits> initialMemoryLimits;
+  vector<vector<char>> initialMemories;
+  vector<interp::TypedValue> initialGlobals;
+  vector<vector<Index>> initialTables;
+
+  // Set while executing. A contract reentering itself needs a separate instance.
+  atomic<bool> inUse{false};
+  bool dirty = false;
+
+  void saveInitialState();
+  void restoreInitialState();
+  void releaseGrownMemories() noexcept;
+  size_t size() const;
+};
+
+void WabtInstance::saveInitialState()
+{
+  for (Index i = 0; i < env.GetMemoryCount(); ++i) {
+    initialMemoryLimits.push_back(env.GetMemory(i)->page_limits);
+    initialMemories.push_back(env.GetMemory(i)->data);
+  }
+  for (Index i = 0; i < env.GetGlobalCount(); ++i)
+    initialGlobals.push_back(env.GetGlobal(i)->typed_value);
+  for (Index i = 0; i < env.GetTableCount(); ++i)
+    initialTables.push_back(env.GetTable(i)->func_indexes);
+}
+
+void WabtInstance::restoreInitialState()
+{
+  // NOTE: assign() keeps the capacity, hence memories that did not grow are not reallocated.
+  for (Index i = 0; i < initialMemories.size(); ++i) {
+    env.GetMemory(i)->page_limits = initialMemoryLimits[i];
+    env.GetMemory(i)->data.assign(initialMemories[i].begin(), initialMemories[i].end());
+  }
+  for (Index i = 0; i < initialGlobals.size(); ++i)
+    env.GetGlobal(i)->typed_value = initialGlobals[i];
+  for (Index i = 0; i < initialTables.size(); ++i)
+    env.GetTable(i)->func_indexes = initialTables[i];
+}
+
+// Frees the memories grown beyond their initial size, as the cache only accounts for
+// the initial size. They are restored before the next execution.
+void WabtInstance::releaseGrownMemories() noexcept
+{
+  for (Index i = 0; i < initialMemories.size(); ++i) {
+    vector<char>& data = env.GetMemory(i)->data;
+    if (data.capacity() > initialMemories[i].size())
+      vector<char>{}.swap(data);
+  }
+}
+
+size_t WabtInstance::size() const
+{
+  // Account for both the live memory and its initial copy.
+  size_t ret = 0;
+  for (auto const& memory: initialMemories)
+    ret += 2 * memory.size();
+  return ret;
+}
+
+// Marks an instance as in use for the duration of an execution.
+struct WabtInstanceKeeper {
+  WabtInstanceKeeper(WabtInstance& _instance, WabtEthereumInterface& interface) noexcept:
+    instance(_instance)
+  {
+    instance.interface = &interface;
+  }
+
+  ~WabtInstanceKeeper() noexcept
+  {
+    instance.interface = nullptr;
+    instance.releaseGrownMemories();
+    instance.dirty = true;
+    instance.inUse = false;
+  }
+
+  WabtInstance& instance;
+};
+
+// Instances of the recently executed contracts, shared by every engine instance.
+// The limit on bytes is accounted in terms of the code and memory sizes.
+CodeCache<WabtInstance> instanceCache{256, 256 * 1024 * 1024};
+
+unique_ptr<WabtInstance> instantiate(bytes_view code)
+{
+  // Set up the wabt Environment, which includes the Wasm store
+  // and the list of modules used for importing/exporting between modules
+  auto instance = make_unique<WabtInstance>();
+  interp::Environment& env = instance->env;
+
+  appendHostModules(env, instance->interface);
+
   // Parse module
   ReadBinaryOptions options(
     Features{},
@@ -697,7 +789,7 @@ ExecutionResult WabtEngine::execute(
 
 #if HERA_DEBUGGING
   for (auto it = errors.begin(); it != errors.end(); ++it) {
-    HERA_DEBUG << "wabt (execute): " << it->message << "\n";
+    HERA_DEBUG << "wabt: " << it->message << "\n";
   }
 #endif
 
@@ -706,593 +798,90 @@ ExecutionResult WabtEngine::execute(
   ensureCondition(module->GetExport("memory"), ContractValidationFailure, "\"memory\" not found");
   ensureCondition(module->start_func_index == kInvalidIndex, ContractValidationFailure, "Contract contains start function.");
 
-  // Prepare to execute
   interp::Export* mainFunction = module->GetExport("main");
   ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
   ensureCondition(mainFunction->kind == ExternalKind::Func, ContractValidationFailure,  "\"main\" is not a function");
+  instance->mainFunction = mainFunction;
+
+  instance->saveInitialState();
+
+  return instance;
+}
+
+// Returns the cached instance of the code, or instantiates it.
+shared_ptr<WabtInstance> loadInstance(bytes_view code)
+{
+  if (auto cached = instanceCache.find(code))
+    return cached;
+
+  shared_ptr<WabtInstance> instance = instantiate(code);
+  size_t cost = code.size() + instance->size();
+  return instanceCache.insert(code, move(instance), cost);
+}
+
+}
+
+unique_ptr<WasmEngine> WabtEngine::create()
+{
+  return unique_ptr<WasmEngine>{new WabtEngine};
+}
+
+ExecutionResult WabtEngine::execute(
+  evmc::HostContext& context,
+  bytes_view code,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
+) {
+  instantiationStarted();
+  HERA_DEBUG << "Executing with wabt...\n";
+
+  // Set up interface to eei host functions
+  ExecutionResult result;
+  WabtEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas, storageWriteBack, logBuffering};
+
+  shared_ptr<WabtInstance> instance = loadInstance(code);
+  if (instance->inUse.exchange(true)) {
+    HERA_DEBUG << "Contract is already executing, instantiating it again.\n";
+    instance = instantiate(code);
+    instance->inUse = true;
+  }
+  WabtInstanceKeeper instanceKeeper{*instance, interface};
+  if (instance->dirty)
+    instance->restoreInitialState();
+
+  // Prepare to execute
   interp::Executor executor(
-    &env,
+    &instance->env,
     nullptr, // null for no tracing
     interp::Thread::Options{} // empty for no threads
   );
 
   // FIXME: really bad design
-  interface.setWasmMemory(env.GetMemory(0));
+  interface.setWasmMemory(instance->env.GetMemory(0));
 
   executionStarted();
 
   // Execute main
   try {
-    interp::ExecResult wabtResult = executor.RunExport(mainFunction, interp::TypedValues{}); // second arg is empty since no args
+    interp::ExecResult wabtResult = executor.RunExport(instance->mainFunction, interp::TypedValues{}); // second arg is empty since no args
     // Wrap any non-EEI exception under VMTrap.
     ensureCondition(wabtResult.result == interp::Result::Ok, VMTrap, "The VM invocation had a trap.");
   } catch (EndExecution const&) {
     // This exception is ignored here because we consider it to be a success.
     // It is only a clutch for POSIX style exit()
   }
+  interface.executionCompleted();
 
   executionFinished();
   return result;
 }
 
 void WabtEngine::verifyContract(bytes_view code) {
-  // Set up the wabt Environment, which includes the Wasm store
-  // and the list of modules used for importing/exporting between modules
-  interp::Environment env;
-
-  // Create EEI host module
-  // The lifecycle of this pointer is handled by `env`.
-  interp::HostModule* hostModule = env.AppendHostModule("ethereum");
-  heraAssert(hostModule, "Failed to create host module.");
-
-  hostModule->AppendFuncExport(
-    "useGas",
-    {{Type::I64}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getAddress",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getExternalBalance",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockHash",
-    {{Type::I64, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "call",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCallDataSize",
-    {{}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callCode",
-    {{Type::I64, Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callDelegate",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "callStatic",
-    {{Type::I64, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageStore",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "storageLoad",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCaller",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCallValue",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "codeCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getCodeSize",
-    {{}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockCoinbase",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "create",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockDifficulty",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "externalCodeCopy",
-    {{Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getExternalCodeSize",
-    {{Type::I32}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getGasLeft",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockGasLimit",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getTxGasPrice",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "log",
-    {{Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockNumber",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getTxOrigin",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "finish",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "revert",
-    {{Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getReturnDataSize",
-    {{}, {Type::I32}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "returnDataCopy",
-    {{Type::I32, Type::I32, Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "selfDestruct",
-    {{Type::I32}, {}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "getBlockTimestamp",
-    {{}, {Type::I64}},
-    [](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-#if HERA_DEBUGGING
-  // Create debug host module
-  // The lifecycle of this pointer is handled by `env`.
-  hostModule = env.AppendHostModule("debug");
-  heraAssert(hostModule, "Failed to create host module.");
-
-  hostModule->AppendFuncExport(
-    "print32",
-    {{Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "print64",
-    {{Type::I64}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printMem",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printMemHex",
-    {{Type::I32, Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printStorage",
-    {{Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-
-  hostModule->AppendFuncExport(
-    "printStorageHex",
-    {{Type::I32}, {}},
-    [&](
-      const interp::HostFunc*,
-      const interp::FuncSignature*,
-      const interp::TypedValues&,
-      interp::TypedValues&
-    ) {
-      return interp::Result::Ok;
-    }
-  );
-#endif
-
-  // Parse module
-  ReadBinaryOptions options(
-    Features{},
-    nullptr, // debugging stream for loading
-    false, // ReadDebugNames
-    true, // StopOnFirstError
-    true // FailOnCustomSectionError
-  );
-
-  Errors errors;
-  interp::DefinedModule* module = nullptr;
-  Result loadResult = ReadBinaryInterp(
-    &env,
-    code.data(),
-    code.size(),
-    options,
-    &errors,
-    &module
-  );
-
-#if HERA_DEBUGGING
-  for (auto it = errors.begin(); it != errors.end(); ++it) {
-    HERA_DEBUG << "wabt (verifyContract): " << it->message << "\n";
-  }
-#endif
-
-  ensureCondition(Succeeded(loadResult) && module, ContractValidationFailure, "Module failed to load.");
-  ensureCondition(env.GetMemoryCount() == 1, ContractValidationFailure, "Multiple memory sections exported.");
-  ensureCondition(module->GetExport("memory"), ContractValidationFailure, "\"memory\" not found");
-  ensureCondition(module->start_func_index == kInvalidIndex, ContractValidationFailure, "Contract contains start function.");
-
-  interp::Export* mainFunction = module->GetExport("main");
-  ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
-  ensureCondition(mainFunction->kind == ExternalKind::Func, ContractValidationFailure,  "\"main\" is not a function");
-};
+  // This also warms the cache for the deployed code.
+  loadInstance(code);
+}
 
 }
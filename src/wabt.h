@@ -30,7 +30,9 @@ public:
     bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
   ) override;
 
   void verifyContract(bytes_view code) override;
@@ -15,10 +15,14 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stack>
 #include <map>
+#include <vector>
 
 #include "wavm.h"
 
@@ -31,10 +35,17 @@
 #include "Runtime/Runtime.h"
 #include "WASM/WASM.h"
 
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Host.h>
+
+#include "cache.h"
 #include "debugging.h"
-#include "eei.h"
+#include "eei-impl.h"
 #include "exceptions.h"
 
+#include <hera/buildinfo.h>
+
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
@@ -42,16 +53,68 @@ using namespace std;
 
 namespace hera {
 
-class WavmEthereumInterface : public EthereumInterface {
+// The IR and native code of a contract, shared by every engine instance.
+struct WavmModule {
+  IR::Module moduleIR;
+  Runtime::GCPointer<Runtime::Module> module;
+};
+
+namespace {
+CodeCache<WavmModule> moduleCache{1024, 64 * 1024 * 1024};
+
+// Object code persisted on disk, if enabled. Replaced atomically by setModuleCacheDirectory().
+shared_ptr<DiskCache const> moduleDiskCache;
+
+// Compiling and loading object code go through LLVM, hence they are serialised on their own.
+// Executions do not wait for compilations in the background (see TieredEngine).
+mutex compileMutex;
+
+// Objects are only referenced once their creation returns, hence the garbage collection, which
+// scans the objects of every thread, excludes creating objects. Creators hold this shared,
+// the collection exclusively.
+shared_mutex gcMutex;
+
+// Identifies everything the object code depends on besides the contract: the Hera,
+// WAVM and LLVM versions, the target and the features of the host CPU it is compiled for.
+string objectCodeTag()
+{
+  string tag = string("hera-") + hera_get_buildinfo()->project_version;
+  tag += string("-wavm-") + HERA_WAVM_COMMIT;
+  tag += string("-llvm-") + LLVM_VERSION_STRING;
+  tag += "-" + llvm::sys::getProcessTriple();
+  tag += "-" + llvm::sys::getHostCPUName().str();
+
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    vector<string> enabled;
+    for (auto const& feature: features)
+      if (feature.getValue())
+        enabled.push_back(feature.getKey().str());
+    // The order of a StringMap is unspecified.
+    sort(enabled.begin(), enabled.end());
+    for (auto const& feature: enabled)
+      tag += "+" + feature;
+  }
+
+#if HERA_DEBUGGING
+  tag += "-debugging";
+#endif
+  return tag;
+}
+}
+
+class WavmEthereumInterface : public EthereumInterface<WavmEthereumInterface> {
 public:
   explicit WavmEthereumInterface(
     evmc::HostContext& _context,
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
-    bool _meterGas
+    bool _meterGas,
+    bool _writeBack,
+    bool _bufferLogs
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface(_context, _code, _msg, _result, _meterGas, _writeBack, _bufferLogs)
   {}
 
   void setWasmMemory(Runtime::MemoryInstance* _wasmMemory) {
@@ -59,11 +122,11 @@ public:
   }
 
 private:
+  friend class EthereumInterface<WavmEthereumInterface>;
+
   // These assume that m_wasmMemory was set prior to execution.
-  size_t memorySize() const override { return Runtime::getMemoryNumPages(m_wasmMemory) * 65536; }
-  void memorySet(size_t offset, uint8_t value) override { Runtime::memoryRef<U8>(m_wasmMemory, offset) = value; }
-  uint8_t memoryGet(size_t offset) override { return Runtime::memoryRef<U8>(m_wasmMemory, offset); }
-  uint8_t* memoryPointer(size_t offset, size_t length) override {
+  size_t memorySize() const { return Runtime::getMemoryNumPages(m_wasmMemory) * 65536; }
+  uint8_t* memoryPointer(size_t offset, size_t length) {
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
     return Runtime::memoryArrayPtr<U8>(m_wasmMemory, offset, length);
   }
@@ -76,9 +139,28 @@ unique_ptr<WasmEngine> WavmEngine::create()
   return unique_ptr<WasmEngine>{new WavmEngine};
 }
 
+void WavmEngine::setModuleCacheMaxEntries(size_t maxEntries)
+{
+  moduleCache.setMaxEntries(maxEntries);
+}
+
+void WavmEngine::setModuleCacheMaxBytes(size_t maxBytes)
+{
+  moduleCache.setMaxBytes(maxBytes);
+}
+
+void WavmEngine::setModuleCacheDirectory(string const& directory)
+{
+  shared_ptr<DiskCache const> diskCache;
+  if (!directory.empty())
+    diskCache = make_shared<DiskCache const>(directory, "wavm", objectCodeTag());
+  atomic_store(&moduleDiskCache, move(diskCache));
+}
+
 namespace wavm_host_module {
   // first the ethereum interface(s), the top of the stack is used in host functions
-  stack<WavmEthereumInterface*> interface;
+  // each thread has its own, as host functions have no other way to find their caller
+  thread_local stack<WavmEthereumInterface*> interface;
 
   // the host module is called 'ethereum'
   DEFINE_INTRINSIC_MODULE(ethereum)
@@ -221,22 +303,22 @@ namespace wavm_host_module {
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "call", U32, call, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
   {
-    return interface.top()->eeiCall(EthereumInterface::EEICallKind::Call, gas, addressOffset, valueOffset, dataOffset, dataLength);
+    return interface.top()->eeiCall(WavmEthereumInterface::EEICallKind::Call, gas, addressOffset, valueOffset, dataOffset, dataLength);
   }
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "callCode", U32, callCode, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
   {
-    return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallCode, gas, addressOffset, valueOffset, dataOffset, dataLength);
+    return interface.top()->eeiCall(WavmEthereumInterface::EEICallKind::CallCode, gas, addressOffset, valueOffset, dataOffset, dataLength);
   }
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "callDelegate", U32, callDelegate, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
   {
-    return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallDelegate, gas, addressOffset, 0, dataOffset, dataLength);
+    return interface.top()->eeiCall(WavmEthereumInterface::EEICallKind::CallDelegate, gas, addressOffset, 0, dataOffset, dataLength);
   }
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "callStatic", U32, callStatic, I64 gas, U32 addressOffset, U32 dataOffset, U32 dataLength)
   {
-    return interface.top()->eeiCall(EthereumInterface::EEICallKind::CallStatic, gas, addressOffset, 0, dataOffset, dataLength);
+    return interface.top()->eeiCall(WavmEthereumInterface::EEICallKind::CallStatic, gas, addressOffset, 0, dataOffset, dataLength);
   }
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "create", U32, create, U32 valueOffset, U32 dataOffset, U32 dataLength, U32 resultOffset)
@@ -272,6 +354,101 @@ namespace wavm_host_module {
   };
 } // namespace wavm_host_module
 
+namespace {
+// A compartment with the host module instantiated into it, reused across executions.
+// Contract instances are created in it per execution and freed by the garbage collection.
+struct WavmCompartment {
+  Runtime::GCPointer<Runtime::Compartment> compartment;
+  Runtime::GCPointer<Runtime::ModuleInstance> ethereumHostModule;
+  wavm_host_module::HeraWavmResolver resolver;
+  // context stores the compartment and some other stuff
+  Runtime::GCPointer<Runtime::Context> context;
+};
+
+// The compartments of a thread, one per call depth.
+using CompartmentPool = vector<unique_ptr<WavmCompartment>>;
+
+// Pools left by exited threads. Intentionally leaked, as the WAVM runtime may be torn down first on exit.
+mutex& idlePoolsMutex()
+{
+  static auto& ret = *new mutex;
+  return ret;
+}
+
+vector<CompartmentPool*>& idlePools()
+{
+  static auto& pools = *new vector<CompartmentPool*>;
+  return pools;
+}
+
+// Hands the pool of a thread over to the next thread on exit, hence there are no more pools
+// than threads executing at once.
+struct ThreadCompartments {
+  CompartmentPool* pool = nullptr;
+
+  ~ThreadCompartments() noexcept
+  {
+    if (!pool)
+      return;
+    lock_guard<mutex> lock{idlePoolsMutex()};
+    idlePools().push_back(pool);
+  }
+};
+
+// Returns the compartment for executions at the given call depth on the calling thread.
+// Each depth has its own, as a compartment can only hold a limited number of memories,
+// and each thread has its own, as they hold the state of an execution.
+WavmCompartment& compartmentForDepth(size_t depth)
+{
+  thread_local ThreadCompartments local;
+  if (!local.pool) {
+    lock_guard<mutex> lock{idlePoolsMutex()};
+    if (idlePools().empty()) {
+      local.pool = new CompartmentPool;
+    } else {
+      local.pool = idlePools().back();
+      idlePools().pop_back();
+    }
+  }
+
+  CompartmentPool& compartments = *local.pool;
+  while (compartments.size() <= depth) {
+    shared_lock<shared_mutex> gcLock{gcMutex};
+    auto pooled = unique_ptr<WavmCompartment>{new WavmCompartment};
+    // compartment is like the Wasm store, represents the VM, has lists of globals, memories, tables, and also has wavm's runtime stuff
+    pooled->compartment = Runtime::createCompartment();
+    pooled->ethereumHostModule = Intrinsics::instantiateModule(pooled->compartment, wavm_host_module::INTRINSIC_MODULE_REF(ethereum), "ethereum", {});
+    heraAssert(pooled->ethereumHostModule, "Failed to create host module.");
+    pooled->resolver.moduleNameToInstanceMap.set("ethereum", pooled->ethereumHostModule);
+    pooled->context = Runtime::createContext(pooled->compartment);
+    compartments.push_back(move(pooled));
+  }
+  return *compartments[depth];
+}
+
+// Contract instances created by the calling thread since its last garbage collection.
+thread_local size_t instancesSinceCollection = 0;
+
+// Collects the instances of finished executions. Nested calls normally leave this to the
+// outermost one, unless so many instances piled up that a compartment could run out of memories.
+// Collections are skipped while a compilation is in progress, unless they are required.
+void collectGarbage(bool outermost)
+{
+  constexpr size_t maxInstancesBetweenCollections = 64;
+  bool const required = ++instancesSinceCollection >= maxInstancesBetweenCollections;
+  if (!outermost && !required)
+    return;
+
+  unique_lock<shared_mutex> lock{gcMutex, defer_lock};
+  if (required)
+    lock.lock();
+  else if (!lock.try_lock())
+    return;
+  Runtime::collectGarbage();
+  instancesSinceCollection = 0;
+}
+}
+
 struct WavmInterfaceKeeper {
   explicit WavmInterfaceKeeper(WavmEthereumInterface& interface)
   {
@@ -286,18 +463,47 @@ ExecutionResult WavmEngine::execute(
   bytes_view code,
   bytes_view state_code,
   evmc_message const& msg,
-  bool meterInterfaceGas
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
+) {
+  instantiationStarted();
+  shared_ptr<WavmModule> compiled = loadModule(code);
+  return runModule(*compiled, context, state_code, msg, meterInterfaceGas, storageWriteBack, logBuffering);
+}
+
+ExecutionResult WavmEngine::executeModule(
+  WavmModule const& compiled,
+  evmc::HostContext& context,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
+) {
+  instantiationStarted();
+  return runModule(compiled, context, state_code, msg, meterInterfaceGas, storageWriteBack, logBuffering);
+}
+
+ExecutionResult WavmEngine::runModule(
+  WavmModule const& compiled,
+  evmc::HostContext& context,
+  bytes_view state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
 ) {
+  bool const outermost = wavm_host_module::interface.empty();
   try {
-    instantiationStarted();
-    ExecutionResult result = internalExecute(context, code, state_code, msg, meterInterfaceGas);
+    ExecutionResult result = internalExecute(compiled, context, state_code, msg, meterInterfaceGas, storageWriteBack, logBuffering);
     // And clean up mess left by this run.
-    Runtime::collectGarbage();
+    collectGarbage(outermost);
     executionFinished();
     return result;
   } catch (exception const&) {
     // And clean up mess left by this run.
-    Runtime::collectGarbage();
+    collectGarbage(outermost);
     // We only catch this exception here in order to clean up garbage..
     // TODO: hopefully WAVM is fixed so that this isn't needed
     throw;
@@ -323,45 +529,86 @@ IR::Module WavmEngine::parseModule(bytes_view code)
   return moduleIR;
 }
 
+shared_ptr<WavmModule> WavmEngine::loadModule(bytes_view code)
+{
+  if (auto cached = moduleCache.find(code))
+    return cached;
+  return loadParsedModule(code, parseModule(code));
+}
+
+shared_ptr<WavmModule> WavmEngine::loadParsedModule(bytes_view code, IR::Module moduleIR)
+{
+  Runtime::GCPointer<Runtime::Module> module;
+  shared_ptr<DiskCache const> diskCache = atomic_load(&moduleDiskCache);
+  DiskCacheEntry objectCode;
+  if (diskCache)
+    objectCode = diskCache->load(code);
+
+  vector<U8> compiledObjectCode;
+  {
+    lock_guard<mutex> lock{compileMutex};
+    shared_lock<shared_mutex> gcLock{gcMutex};
+
+    if (objectCode) {
+      HERA_DEBUG << "Loading precompiled contract (" << objectCode.value().size() << " bytes of object code)\n";
+      try {
+        // WAVM only takes the object code as a vector, hence it is copied out of the mapping.
+        module = Runtime::loadPrecompiledModule(moduleIR, vector<U8>(objectCode.value().begin(), objectCode.value().end()));
+      } catch (...) {
+        // Handled below.
+      }
+      if (!module)
+        HERA_DEBUG << "Couldn't load precompiled object code, recompiling.\n";
+    }
+
+    if (!module) {
+      // compile the module from IR to LLVM bitcode
+      module = Runtime::compileModule(moduleIR);
+      heraAssert(module, "Couldn't compile IR to bitcode.");
+
+      if (diskCache)
+        compiledObjectCode = Runtime::getObjectCode(module);
+    }
+  }
+
+  // This also replaces an entry that could not be loaded.
+  if (!compiledObjectCode.empty())
+    diskCache->store(code, {compiledObjectCode.data(), compiledObjectCode.size()});
+
+  // The cache is thread-safe on its own.
+  auto compiled = make_shared<WavmModule>(WavmModule{move(moduleIR), module});
+  return moduleCache.insert(code, move(compiled), code.size());
+}
+
 ExecutionResult WavmEngine::internalExecute(
+  WavmModule const& compiled,
   evmc::HostContext& context,
-  bytes_view code,
   bytes_view state_code,
   evmc_message const& msg,
-  bool meterInterfaceGas
+  bool meterInterfaceGas,
+  bool storageWriteBack,
+  bool logBuffering
 ) {
   HERA_DEBUG << "Executing with wavm...\n";
 
-  IR::Module moduleIR = parseModule(code);
-
   // set up a new ethereum interface just for this contract invocation
   ExecutionResult result;
-  WavmEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
+  WavmEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas, storageWriteBack, logBuffering};
   WavmInterfaceKeeper interfaceKeeper{interface};
 
-  // next set up the VM
-  // Note: in ewasm, we create a new VM for each call to a module, so we must instantiate a new host module for each of these VMs, this is inefficient, but OK for prototyping.
-
-  // compartment is like the Wasm store, represents the VM, has lists of globals, memories, tables, and also has wavm's runtime stuff
-  Runtime::GCPointer<Runtime::Compartment> compartment = Runtime::createCompartment();
-
-  // instantiate host Module
-  Runtime::GCPointer<Runtime::ModuleInstance> ethereumHostModule = Intrinsics::instantiateModule(compartment, wavm_host_module::INTRINSIC_MODULE_REF(ethereum), "ethereum", {});
-  heraAssert(ethereumHostModule, "Failed to create host module.");
+  // next set up the VM, only the contract instance and its memory are created per call
+  WavmCompartment& vm = compartmentForDepth(wavm_host_module::interface.size() - 1);
 
   // prepare contract module to resolve links against host module
-  wavm_host_module::HeraWavmResolver resolver;
-  // TODO: move this into the constructor?
-  resolver.moduleNameToInstanceMap.set("ethereum", ethereumHostModule);
-  Runtime::LinkResult linkResult = Runtime::linkModule(moduleIR, resolver);
+  Runtime::LinkResult linkResult = Runtime::linkModule(compiled.moduleIR, vm.resolver);
   ensureCondition(linkResult.success, ContractValidationFailure, "Couldn't link contract against host module.");
 
-  // compile the module from IR to LLVM bitcode
-  Runtime::GCPointer<Runtime::Module> module = Runtime::compileModule(moduleIR);
-  heraAssert(module, "Couldn't compile IR to bitcode.");
-
   // instantiate contract module
-  Runtime::GCPointer<Runtime::ModuleInstance> moduleInstance = Runtime::instantiateModule(compartment, module, move(linkResult.resolvedImports), "<ewasmcontract>");
+  Runtime::GCPointer<Runtime::ModuleInstance> moduleInstance;
+  {
+    shared_lock<shared_mutex> gcLock{gcMutex};
+    moduleInstance = Runtime::instantiateModule(vm.compartment, compiled.module, move(linkResult.resolvedImports), "<ewasmcontract>");
+  }
   heraAssert(moduleInstance, "Couldn't instantiate contact module.");
 
   ensureCondition(!Runtime::getStartFunction(moduleInstance), ContractValidationFailure, "Contract contains start function.");
@@ -385,9 +632,7 @@ ExecutionResult WavmEngine::internalExecute(
   Runtime::catchRuntimeExceptions(
     [&] {
       try {
-        // context stores the compartment and some other stuff
-        Runtime::GCPointer<Runtime::Context> wavm_context = Runtime::createContext(compartment);
-        Runtime::invokeFunctionChecked(wavm_context, mainFunction, {} /* function parameters */);
+        Runtime::invokeFunctionChecked(vm.context, mainFunction, {} /* function parameters */);
       } catch (EndExecution const&) {
         // This exception is ignored here because we consider it to be a success.
         // It is only a clutch for POSIX style exit()
@@ -398,14 +643,34 @@ ExecutionResult WavmEngine::internalExecute(
       ensureCondition(false, VMTrap, Runtime::describeException(exception));
     }
   );
+  interface.executionCompleted();
 
   return result;
 }
 
-void WavmEngine::verifyContract(bytes_view code)
+void WavmEngine::prepareContract(bytes_view code)
+{
+  compileContract(code);
+}
+
+shared_ptr<WavmModule> WavmEngine::compileContract(bytes_view code)
 {
+  // The code is parsed once for both the verification and the compilation.
+  // Cached modules are verified too, as executions do not verify the code.
   IR::Module moduleIR = parseModule(code);
+  verifyModule(moduleIR);
+  if (auto cached = moduleCache.find(code))
+    return cached;
+  return loadParsedModule(code, move(moduleIR));
+}
+
+void WavmEngine::verifyContract(bytes_view code)
+{
+  verifyModule(parseModule(code));
+}
 
+void WavmEngine::verifyModule(IR::Module const& moduleIR)
+{
   ensureCondition(moduleIR.startFunctionIndex == UINTPTR_MAX, ContractValidationFailure, "Contract contains start function.");
 
   ensureCondition(moduleIR.memories.size() == 1, ContractValidationFailure, "Multiple memory sections exported.");
@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include "eei.h"
 
 namespace IR {
@@ -25,6 +28,8 @@ class Module;
 
 namespace hera {
 
+struct WavmModule;
+
 class WavmEngine : public WasmEngine {
 public:
   /// Factory method to create the WAVM Wasm Engine.
@@ -35,21 +40,70 @@ public:
     bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
   ) override;
 
   void verifyContract(bytes_view code) override;
 
+  void prepareContract(bytes_view code) override;
+
+  /// Returns the compiled module for the code, from the caches or by compiling it.
+  /// Throws ContractValidationFailure if the code is invalid. The module stays
+  /// usable after it is evicted from the caches.
+  std::shared_ptr<WavmModule> compileContract(bytes_view code);
+
+  /// Executes a module returned by compileContract().
+  ExecutionResult executeModule(
+    WavmModule const& compiled,
+    evmc::HostContext& context,
+    bytes_view state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
+  );
+
+  /// Sets the limits of the process-wide cache of compiled contracts.
+  /// The size is accounted in terms of the Wasm binary size.
+  static void setModuleCacheMaxEntries(size_t maxEntries);
+  static void setModuleCacheMaxBytes(size_t maxBytes);
+
+  /// Sets the directory where compiled contracts are persisted across processes.
+  /// An empty string disables persistence.
+  static void setModuleCacheDirectory(std::string const& directory);
+
 private:
+  ExecutionResult runModule(
+    WavmModule const& compiled,
+    evmc::HostContext& context,
+    bytes_view state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
+  );
+
   ExecutionResult internalExecute(
+    WavmModule const& compiled,
     evmc::HostContext& context,
-    bytes_view code,
     bytes_view state_code,
     evmc_message const& msg,
-    bool meterInterfaceGas
+    bool meterInterfaceGas,
+    bool storageWriteBack,
+    bool logBuffering
   );
 
   IR::Module parseModule(bytes_view code);
+
+  static void verifyModule(IR::Module const& moduleIR);
+
+  /// Returns the compiled module for the code, either from the cache or by compiling it.
+  std::shared_ptr<WavmModule> loadModule(bytes_view code);
+
+  /// Compiles the parsed code, or loads its persisted object code, and caches it.
+  std::shared_ptr<WavmModule> loadParsedModule(bytes_view code, IR::Module moduleIR);
 };
 
 } // namespace hera
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "cache.h"
+
+using namespace hera;
+using namespace std;
+
+namespace {
+
+bytes code(uint8_t id, size_t size = 4)
+{
+  return bytes(size, id);
+}
+
+// A private directory, removed with its files at the end of the test.
+class disk_cache : public testing::Test {
+protected:
+  void SetUp() override
+  {
+    char path[] = "/tmp/hera-cache-test-XXXXXX";
+    ASSERT_NE(::mkdtemp(path), nullptr);
+    directory = path;
+  }
+
+  void TearDown() override
+  {
+    for (string const& file: files())
+      ::unlink(file.c_str());
+    ::rmdir(directory.c_str());
+  }
+
+  vector<string> files() const
+  {
+    vector<string> ret;
+    if (DIR* dir = ::opendir(directory.c_str())) {
+      while (dirent* entry = ::readdir(dir)) {
+        string const name = entry->d_name;
+        if (name != "." && name != "..")
+          ret.push_back(directory + "/" + name);
+      }
+      ::closedir(dir);
+    }
+    return ret;
+  }
+
+  // Overwrites the byte at @offset from the end of the only cache file.
+  void corrupt(size_t offset)
+  {
+    vector<string> const cacheFiles = files();
+    ASSERT_EQ(cacheFiles.size(), 1);
+    fstream file{cacheFiles.front(), ios::in | ios::out | ios::binary};
+    file.seekg(-static_cast<streamoff>(offset), ios::end);
+    char byte = static_cast<char>(file.get());
+    file.seekp(-static_cast<streamoff>(offset), ios::end);
+    file.put(static_cast<char>(byte ^ 0xff));
+  }
+
+  string directory;
+};
+
+bytes_view view(char const* str)
+{
+  return {reinterpret_cast<uint8_t const*>(str), strlen(str)};
+}
+
+}
+
+TEST(code_cache, find_inserted)
+{
+  CodeCache<int> cache{4, 1024};
+  EXPECT_EQ(cache.find(code(1)), nullptr);
+
+  auto value = make_shared<int>(1);
+  EXPECT_EQ(cache.insert(code(1), value, 4), value);
+  EXPECT_EQ(cache.find(code(1)), value);
+  EXPECT_EQ(cache.find(code(2)), nullptr);
+}
+
+TEST(code_cache, insert_keeps_existing_value)
+{
+  CodeCache<int> cache{4, 1024};
+  auto first = make_shared<int>(1);
+  cache.insert(code(1), first, 4);
+  EXPECT_EQ(cache.insert(code(1), make_shared<int>(2), 4), first);
+  EXPECT_EQ(cache.find(code(1)), first);
+}
+
+TEST(code_cache, full_code_is_compared)
+{
+  // A longer code with the same prefix is another contract.
+  CodeCache<int> cache{4, 1024};
+  cache.insert(code(1, 4), make_shared<int>(1), 4);
+  EXPECT_EQ(cache.find(code(1, 5)), nullptr);
+}
+
+TEST(code_cache, evicts_least_recently_used_entry)
+{
+  CodeCache<int> cache{2, 1024};
+  cache.insert(code(1), make_shared<int>(1), 4);
+  cache.insert(code(2), make_shared<int>(2), 4);
+  // Makes 2 the least recently used entry.
+  EXPECT_NE(cache.find(code(1)), nullptr);
+  cache.insert(code(3), make_shared<int>(3), 4);
+
+  EXPECT_NE(cache.find(code(1)), nullptr);
+  EXPECT_EQ(cache.find(code(2)), nullptr);
+  EXPECT_NE(cache.find(code(3)), nullptr);
+}
+
+TEST(code_cache, evicts_by_size)
+{
+  CodeCache<int> cache{16, 10};
+  cache.insert(code(1), make_shared<int>(1), 4);
+  cache.insert(code(2), make_shared<int>(2), 4);
+  cache.insert(code(3), make_shared<int>(3), 4);
+
+  EXPECT_EQ(cache.find(code(1)), nullptr);
+  EXPECT_NE(cache.find(code(2)), nullptr);
+  EXPECT_NE(cache.find(code(3)), nullptr);
+
+  // Values larger than the cache are returned but not cached.
+  auto large = make_shared<int>(4);
+  EXPECT_EQ(cache.insert(code(4), large, 11), large);
+  EXPECT_EQ(cache.find(code(4)), nullptr);
+  EXPECT_NE(cache.find(code(3)), nullptr);
+}
+
+TEST(code_cache, shrinking_limits_evicts)
+{
+  CodeCache<int> cache{4, 1024};
+  cache.insert(code(1), make_shared<int>(1), 4);
+  cache.insert(code(2), make_shared<int>(2), 4);
+
+  cache.setMaxEntries(1);
+  EXPECT_EQ(cache.find(code(1)), nullptr);
+  EXPECT_NE(cache.find(code(2)), nullptr);
+
+  cache.setMaxBytes(3);
+  EXPECT_EQ(cache.find(code(2)), nullptr);
+}
+
+TEST(code_cache, disabled)
+{
+  CodeCache<int> cache{0, 1024};
+  auto value = make_shared<int>(1);
+  EXPECT_EQ(cache.insert(code(1), value, 4), value);
+  EXPECT_EQ(cache.find(code(1)), nullptr);
+}
+
+TEST(code_cache, evicted_value_stays_alive)
+{
+  CodeCache<int> cache{1, 1024};
+  auto value = cache.insert(code(1), make_shared<int>(42), 4);
+  cache.clear();
+  EXPECT_EQ(cache.find(code(1)), nullptr);
+  EXPECT_EQ(*value, 42);
+}
+
+TEST_F(disk_cache, load_stored)
+{
+  DiskCache cache{directory, "test", "tag"};
+  EXPECT_FALSE(cache.load(code(1)));
+
+  cache.store(code(1), view("value"));
+  DiskCacheEntry entry = cache.load(code(1));
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry.value(), view("value"));
+  EXPECT_FALSE(cache.load(code(2)));
+
+  // Replaced atomically, no temporary file is left behind.
+  cache.store(code(1), view("other"));
+  EXPECT_EQ(cache.load(code(1)).value(), view("other"));
+  EXPECT_EQ(files().size(), 1);
+}
+
+TEST_F(disk_cache, shared_by_caches_with_the_same_tag)
+{
+  DiskCache{directory, "test", "tag"}.store(code(1), view("value"));
+  DiskCacheEntry entry = DiskCache{directory, "test", "tag"}.load(code(1));
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry.value(), view("value"));
+}
+
+TEST_F(disk_cache, tag_mismatch)
+{
+  DiskCache{directory, "test", "tag"}.store(code(1), view("value"));
+  EXPECT_FALSE(DiskCache(directory, "test", "other").load(code(1)));
+  // The tag is compared in full.
+  EXPECT_FALSE(DiskCache(directory, "test", "ta").load(code(1)));
+  EXPECT_FALSE(DiskCache(directory, "test", "tag2").load(code(1)));
+}
+
+TEST_F(disk_cache, corrupt_value)
+{
+  DiskCache cache{directory, "test", "tag"};
+  cache.store(code(1), view("value"));
+  corrupt(1);
+  EXPECT_FALSE(cache.load(code(1)));
+
+  // Overwritten by the next store.
+  cache.store(code(1), view("value"));
+  EXPECT_TRUE(cache.load(code(1)));
+}
+
+TEST_F(disk_cache, corrupt_key)
+{
+  DiskCache cache{directory, "test", "tag"};
+  cache.store(code(1), view("value"));
+  corrupt(strlen("value") + 1);
+  EXPECT_FALSE(cache.load(code(1)));
+}
+
+TEST_F(disk_cache, truncated_file)
+{
+  DiskCache cache{directory, "test", "tag"};
+  cache.store(code(1), view("value"));
+  vector<string> const cacheFiles = files();
+  ASSERT_EQ(cacheFiles.size(), 1);
+
+  ASSERT_EQ(::truncate(cacheFiles.front().c_str(), 20), 0);
+  EXPECT_FALSE(cache.load(code(1)));
+  ASSERT_EQ(::truncate(cacheFiles.front().c_str(), 0), 0);
+  EXPECT_FALSE(cache.load(code(1)));
+}
+
+TEST_F(disk_cache, untrusted_directory)
+{
+  DiskCache cache{directory, "test", "tag"};
+  cache.store(code(1), view("value"));
+  EXPECT_TRUE(DiskCache::isValidDirectory(directory));
+
+  ASSERT_EQ(::chmod(directory.c_str(), 0777), 0);
+  EXPECT_FALSE(DiskCache::isValidDirectory(directory));
+  EXPECT_FALSE(cache.load(code(1)));
+
+  ASSERT_EQ(::chmod(directory.c_str(), 0700), 0);
+  EXPECT_TRUE(cache.load(code(1)));
+}
+
+TEST_F(disk_cache, untrusted_file)
+{
+  DiskCache cache{directory, "test", "tag"};
+  cache.store(code(1), view("value"));
+  vector<string> const cacheFiles = files();
+  ASSERT_EQ(cacheFiles.size(), 1);
+
+  ASSERT_EQ(::chmod(cacheFiles.front().c_str(), 0666), 0);
+  EXPECT_FALSE(cache.load(code(1)));
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <evmc/mocked_host.hpp>
+#include <gtest/gtest.h>
+
+#include "eei-impl.h"
+
+using namespace hera;
+using namespace std;
+
+namespace {
+
+// The EEI on top of a plain buffer, standing in for the memory of an engine.
+class TestInterface : public EthereumInterface<TestInterface> {
+public:
+  TestInterface(evmc::HostContext& host, evmc_message const& msg, ExecutionResult& result, bool writeBack, bool bufferLogs):
+    EthereumInterface(host, {}, msg, result, true, writeBack, bufferLogs)
+  {}
+
+  using EthereumInterface::EEICallKind;
+  using EthereumInterface::eeiCall;
+  using EthereumInterface::eeiFinish;
+  using EthereumInterface::eeiLog;
+  using EthereumInterface::eeiRevert;
+  using EthereumInterface::eeiStorageLoad;
+  using EthereumInterface::eeiStorageStore;
+
+  void storeWord(uint32_t offset, evmc::bytes32 const& value) { memcpy(&m_memory[offset], value.bytes, 32); }
+  evmc::bytes32 loadWord(uint32_t offset) const
+  {
+    evmc::bytes32 ret;
+    memcpy(ret.bytes, &m_memory[offset], 32);
+    return ret;
+  }
+
+  // Stores @value at @key through the EEI.
+  void storageStore(evmc::bytes32 const& key, evmc::bytes32 const& value)
+  {
+    storeWord(0, key);
+    storeWord(32, value);
+    eeiStorageStore(0, 32);
+  }
+
+  evmc::bytes32 storageLoad(evmc::bytes32 const& key)
+  {
+    storeWord(0, key);
+    eeiStorageLoad(0, 64);
+    return loadWord(64);
+  }
+
+  // Calls the address at offset 128 with no value and no input.
+  uint32_t call() { return eeiCall(EEICallKind::Call, 10000, 128, 160, 0, 0); }
+
+private:
+  friend class EthereumInterface<TestInterface>;
+
+  size_t memorySize() const noexcept { return m_memory.size(); }
+
+  uint8_t* memoryPointer(size_t offset, size_t length)
+  {
+    ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
+    return &m_memory[offset];
+  }
+
+  array<uint8_t, 1024> m_memory{};
+};
+
+// Records every storage write and how many had been made when calling out.
+class TestHost : public evmc::MockedHost {
+public:
+  evmc_storage_status set_storage(evmc::address const& addr, evmc::bytes32 const& key, evmc::bytes32 const& value) noexcept override
+  {
+    storageWrites.emplace_back(key, value);
+    return MockedHost::set_storage(addr, key, value);
+  }
+
+  evmc::Result call(evmc_message const& msg) noexcept override
+  {
+    storageWritesBeforeCall = storageWrites.size();
+    logsBeforeCall = recorded_logs.size();
+    return MockedHost::call(msg);
+  }
+
+  evmc_tx_context get_tx_context() const noexcept override
+  {
+    ++txContextQueries;
+    return MockedHost::get_tx_context();
+  }
+
+  vector<pair<evmc::bytes32, evmc::bytes32>> storageWrites;
+  size_t storageWritesBeforeCall = 0;
+  size_t logsBeforeCall = 0;
+  mutable size_t txContextQueries = 0;
+};
+
+evmc::bytes32 word(uint8_t value)
+{
+  evmc::bytes32 ret;
+  ret.bytes[31] = value;
+  return ret;
+}
+
+class eei : public testing::Test {
+protected:
+  eei()
+  {
+    msg.kind = EVMC_CALL;
+    msg.gas = 10000000;
+    msg.recipient.bytes[19] = 0x01;
+  }
+
+  TestInterface interface(bool writeBack, bool bufferLogs = false)
+  {
+    return TestInterface{context, msg, result, writeBack, bufferLogs};
+  }
+
+  // Ends the execution like an engine, with finish or revert.
+  static void end(TestInterface& eei, bool revert)
+  {
+    try {
+      if (revert)
+        eei.eeiRevert(0, 0);
+      else
+        eei.eeiFinish(0, 0);
+    } catch (EndExecution const&) {
+    }
+    eei.executionCompleted();
+  }
+
+  evmc::bytes32 stored(uint8_t key) { return host.accounts[msg.recipient].storage[word(key)].value; }
+
+  TestHost host;
+  evmc::HostContext context{host.get_interface(), host.to_context()};
+  evmc_message msg{};
+  ExecutionResult result;
+};
+
+}
+
+TEST_F(eei, storage_written_through_by_default)
+{
+  TestInterface eei = interface(false);
+  eei.storageStore(word(1), word(1));
+  eei.storageStore(word(1), word(2));
+  EXPECT_EQ(host.storageWrites.size(), 2);
+  end(eei, false);
+  EXPECT_EQ(host.storageWrites.size(), 2);
+  EXPECT_EQ(stored(1), word(2));
+}
+
+TEST_F(eei, storage_write_back_coalesces)
+{
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(1));
+  eei.storageStore(word(1), word(2));
+  eei.storageStore(word(2), word(3));
+  eei.storageStore(word(1), word(4));
+  EXPECT_TRUE(host.storageWrites.empty());
+  EXPECT_EQ(eei.storageLoad(word(1)), word(4));
+
+  end(eei, false);
+  EXPECT_EQ(host.storageWrites.size(), 2);
+  EXPECT_EQ(stored(1), word(4));
+  EXPECT_EQ(stored(2), word(3));
+}
+
+TEST_F(eei, storage_write_back_writes_deletes_through)
+{
+  host.accounts[msg.recipient].storage[word(1)].value = word(5);
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(6));
+  EXPECT_TRUE(host.storageWrites.empty());
+
+  // The buffered value is written first, the client sees the deletion of a value it holds.
+  eei.storageStore(word(1), word(0));
+  ASSERT_EQ(host.storageWrites.size(), 2);
+  EXPECT_EQ(host.storageWrites[0].second, word(6));
+  EXPECT_EQ(host.storageWrites[1].second, word(0));
+
+  end(eei, false);
+  EXPECT_EQ(host.storageWrites.size(), 2);
+  EXPECT_EQ(stored(1), word(0));
+}
+
+TEST_F(eei, storage_write_back_skips_unchanged_slots)
+{
+  host.accounts[msg.recipient].storage[word(1)].value = word(5);
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(6));
+  eei.storageStore(word(1), word(5));
+  end(eei, false);
+  EXPECT_TRUE(host.storageWrites.empty());
+  EXPECT_EQ(stored(1), word(5));
+}
+
+TEST_F(eei, storage_write_back_flushes_before_calls)
+{
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(1));
+  EXPECT_EQ(eei.call(), 0);
+  ASSERT_EQ(host.recorded_calls.size(), 1);
+  EXPECT_EQ(host.storageWritesBeforeCall, 1);
+  EXPECT_EQ(stored(1), word(1));
+
+  // Not written again unless changed after the call.
+  end(eei, false);
+  EXPECT_EQ(host.storageWrites.size(), 1);
+}
+
+TEST_F(eei, storage_write_back_reloads_after_calls)
+{
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(1));
+  EXPECT_EQ(eei.call(), 0);
+  // As if changed by the callee.
+  host.accounts[msg.recipient].storage[word(1)].value = word(2);
+  EXPECT_EQ(eei.storageLoad(word(1)), word(2));
+}
+
+TEST_F(eei, storage_write_back_dropped_on_revert)
+{
+  TestInterface eei = interface(true);
+  eei.storageStore(word(1), word(1));
+  end(eei, true);
+  EXPECT_TRUE(result.isRevert);
+  EXPECT_TRUE(host.storageWrites.empty());
+}
+
+TEST_F(eei, storage_write_back_dropped_on_trap)
+{
+  {
+    TestInterface eei = interface(true);
+    eei.storageStore(word(1), word(1));
+    // Engines do not complete executions that trap.
+  }
+  EXPECT_TRUE(host.storageWrites.empty());
+}
+
+TEST_F(eei, logs_emitted_immediately_by_default)
+{
+  TestInterface eei = interface(false, false);
+  eei.storeWord(0, word(7));
+  eei.eeiLog(0, 32, 1, 0, 0, 0, 0);
+  ASSERT_EQ(host.recorded_logs.size(), 1);
+  end(eei, true);
+  EXPECT_EQ(host.recorded_logs.size(), 1);
+}
+
+TEST_F(eei, log_buffering_emits_in_order_on_finish)
+{
+  TestInterface eei = interface(false, true);
+  eei.storeWord(0, word(7));
+  eei.storeWord(32, word(8));
+  eei.eeiLog(0, 32, 0, 0, 0, 0, 0);
+  eei.eeiLog(32, 2, 2, 0, 32, 0, 0);
+  eei.eeiLog(0, 0, 0, 0, 0, 0, 0);
+  // The data is kept, later changes of the memory are not seen.
+  eei.storeWord(0, word(9));
+  EXPECT_TRUE(host.recorded_logs.empty());
+
+  end(eei, false);
+  ASSERT_EQ(host.recorded_logs.size(), 3);
+  EXPECT_EQ(host.recorded_logs[0].creator, msg.recipient);
+  EXPECT_EQ(host.recorded_logs[0].data.size(), 32);
+  EXPECT_EQ(host.recorded_logs[0].data[31], 7);
+  EXPECT_TRUE(host.recorded_logs[0].topics.empty());
+  EXPECT_EQ(host.recorded_logs[1].data.size(), 2);
+  ASSERT_EQ(host.recorded_logs[1].topics.size(), 2);
+  EXPECT_EQ(host.recorded_logs[1].topics[0], word(7));
+  EXPECT_EQ(host.recorded_logs[1].topics[1], word(8));
+  EXPECT_TRUE(host.recorded_logs[2].data.empty());
+}
+
+TEST_F(eei, log_buffering_flushes_before_calls)
+{
+  TestInterface eei = interface(true, true);
+  eei.storageStore(word(1), word(1));
+  eei.eeiLog(0, 32, 0, 0, 0, 0, 0);
+  EXPECT_EQ(eei.call(), 0);
+  EXPECT_EQ(host.logsBeforeCall, 1);
+  EXPECT_EQ(host.storageWritesBeforeCall, 1);
+
+  end(eei, false);
+  EXPECT_EQ(host.recorded_logs.size(), 1);
+}
+
+TEST_F(eei, log_buffering_dropped_on_revert)
+{
+  TestInterface eei = interface(false, true);
+  eei.eeiLog(0, 32, 0, 0, 0, 0, 0);
+  end(eei, true);
+  EXPECT_TRUE(host.recorded_logs.empty());
+}
+
+TEST_F(eei, log_buffering_dropped_on_trap)
+{
+  {
+    TestInterface eei = interface(false, true);
+    eei.eeiLog(0, 32, 0, 0, 0, 0, 0);
+  }
+  EXPECT_TRUE(host.recorded_logs.empty());
+}
+
+TEST_F(eei, transaction_cache_shared_by_nested_frames)
+{
+  TransactionScope transaction;
+  CachingHost outer{context};
+  outer.get_tx_context();
+  outer.get_block_hash(5);
+
+  // A nested execution opens its own scope, which must not replace the outer cache.
+  TransactionScope nestedTransaction;
+  CachingHost nested{context};
+  nested.get_tx_context();
+  nested.get_block_hash(5);
+  nested.get_block_hash(6);
+
+  EXPECT_EQ(host.txContextQueries, 1);
+  EXPECT_EQ(host.recorded_blockhashes, (vector<int64_t>{5, 6}));
+}
+
+TEST_F(eei, transaction_cache_per_host_without_scope)
+{
+  {
+    TransactionScope transaction;
+  }
+  CachingHost first{context};
+  first.get_tx_context();
+  first.get_tx_context();
+  CachingHost second{context};
+  second.get_tx_context();
+
+  EXPECT_EQ(host.txContextQueries, 2);
+}
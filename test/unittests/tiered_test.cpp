@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include <evmc/mocked_host.hpp>
+#include <gtest/gtest.h>
+#include <hera/hera.h>
+
+#include "tiered.h"
+
+using namespace hera;
+using namespace std;
+
+namespace {
+
+// (module (memory 1) (export "memory" (memory 0)) (func $main) (export "main" (func $main)))
+uint8_t const contract[] = {
+  0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+  0x01, 0x04, 0x01, 0x60, 0x00, 0x00,
+  0x03, 0x02, 0x01, 0x00,
+  0x05, 0x03, 0x01, 0x00, 0x01,
+  0x07, 0x11, 0x02,
+  0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x00,
+  0x04, 'm', 'a', 'i', 'n', 0x00, 0x00,
+  0x0a, 0x04, 0x01, 0x02, 0x00, 0x0b,
+};
+
+// The same with two pages of memory, tracked separately.
+uint8_t const otherContract[] = {
+  0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+  0x01, 0x04, 0x01, 0x60, 0x00, 0x00,
+  0x03, 0x02, 0x01, 0x00,
+  0x05, 0x03, 0x01, 0x00, 0x02,
+  0x07, 0x11, 0x02,
+  0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x00,
+  0x04, 'm', 'a', 'i', 'n', 0x00, 0x00,
+  0x0a, 0x04, 0x01, 0x02, 0x00, 0x0b,
+};
+
+class tiered : public testing::Test {
+protected:
+  tiered()
+  {
+    msg.kind = EVMC_CALL;
+    msg.gas = 1000000;
+  }
+
+  ~tiered() override { vm->destroy(vm); }
+
+  template <size_t N>
+  evmc_status_code execute(uint8_t const (&code)[N])
+  {
+    evmc::Result result{vm->execute(vm, &host.get_interface(), host.to_context(), EVMC_BYZANTIUM, &msg, code, N)};
+    return result.status_code;
+  }
+
+  // Waits for the background compilations to finish, up to a minute.
+  static void waitForCompilations(TieringStatistics const& initial, uint64_t count)
+  {
+    auto const deadline = chrono::steady_clock::now() + chrono::minutes{1};
+    while (true) {
+      TieringStatistics const stats = TieredEngine::statistics();
+      if (stats.compilationsFinished + stats.compilationsFailed >= initial.compilationsFinished + initial.compilationsFailed + count)
+        return;
+      ASSERT_LT(chrono::steady_clock::now(), deadline);
+      this_thread::sleep_for(chrono::milliseconds{10});
+    }
+  }
+
+  evmc_vm* vm = evmc_create_hera();
+  evmc::MockedHost host;
+  evmc_message msg{};
+};
+
+}
+
+TEST_F(tiered, compiles_hot_contracts)
+{
+  ASSERT_EQ(vm->set_option(vm, "engine", "tiered"), EVMC_SET_OPTION_SUCCESS);
+  ASSERT_EQ(vm->set_option(vm, "tiered-threshold", "2"), EVMC_SET_OPTION_SUCCESS);
+  TieringStatistics const initial = TieredEngine::statistics();
+
+  // Interpreted until the threshold is reached, which starts the compilation.
+  EXPECT_EQ(execute(contract), EVMC_SUCCESS);
+  EXPECT_EQ(TieredEngine::statistics().compilationsStarted, initial.compilationsStarted);
+  EXPECT_EQ(execute(contract), EVMC_SUCCESS);
+  TieringStatistics stats = TieredEngine::statistics();
+  EXPECT_EQ(stats.interpretedExecutions, initial.interpretedExecutions + 2);
+  EXPECT_EQ(stats.compilationsStarted, initial.compilationsStarted + 1);
+
+  ASSERT_NO_FATAL_FAILURE(waitForCompilations(initial, 1));
+
+  // Compiled once, then executed by WAVM.
+  EXPECT_EQ(execute(contract), EVMC_SUCCESS);
+  stats = TieredEngine::statistics();
+  EXPECT_EQ(stats.compilationsStarted, initial.compilationsStarted + 1);
+  EXPECT_EQ(stats.compilationsFinished, initial.compilationsFinished + 1);
+  EXPECT_EQ(stats.compilationsFailed, initial.compilationsFailed);
+  EXPECT_EQ(stats.compiledExecutions, initial.compiledExecutions + 1);
+  EXPECT_EQ(stats.interpretedExecutions, initial.interpretedExecutions + 2);
+}
+
+TEST_F(tiered, lowering_the_threshold_compiles_warm_contracts)
+{
+  ASSERT_EQ(vm->set_option(vm, "engine", "tiered"), EVMC_SET_OPTION_SUCCESS);
+  ASSERT_EQ(vm->set_option(vm, "tiered-threshold", "100"), EVMC_SET_OPTION_SUCCESS);
+  TieringStatistics const initial = TieredEngine::statistics();
+
+  EXPECT_EQ(execute(otherContract), EVMC_SUCCESS);
+  EXPECT_EQ(execute(otherContract), EVMC_SUCCESS);
+  EXPECT_EQ(TieredEngine::statistics().compilationsStarted, initial.compilationsStarted);
+
+  // Already past the new threshold, queued on the next execution.
+  ASSERT_EQ(vm->set_option(vm, "tiered-threshold", "1"), EVMC_SET_OPTION_SUCCESS);
+  EXPECT_EQ(execute(otherContract), EVMC_SUCCESS);
+  EXPECT_EQ(TieredEngine::statistics().compilationsStarted, initial.compilationsStarted + 1);
+  ASSERT_NO_FATAL_FAILURE(waitForCompilations(initial, 1));
+  EXPECT_EQ(TieredEngine::statistics().compilationsFinished, initial.compilationsFinished + 1);
+}